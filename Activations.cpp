@@ -1,6 +1,7 @@
 #pragma once
 #include <iostream>
 #include <cmath>
+#include <cstring>
 
 
 namespace Activations {
@@ -12,24 +13,58 @@ namespace Activations {
         unsigned int inputsNumber;
         double* gradient;
         double* outputs;
+        bool ownsBuffers;
 
         InnerActivation(unsigned int _inputsNumber) 
-        : inputsNumber(_inputsNumber)
+        : inputsNumber(_inputsNumber),
+          ownsBuffers(true)
         {
             inputs = new double[inputsNumber];
             gradient = new double[inputsNumber];
             outputs = new double[inputsNumber];
         };
 
-        ~InnerActivation() {
-            delete[] inputs;
-            delete[] gradient;
-            delete[] outputs;
+        virtual ~InnerActivation() {
+            if (ownsBuffers) {
+                delete[] inputs;
+                delete[] gradient;
+                delete[] outputs;
+            }
+        }
+
+
+        void bindBuffers(double* _inputs, double* _outputs, double* _gradient) {
+            /*
+                replaces the activation's own buffers with buffers owned
+                by someone else (see MemoryPlan)
+                _inputs can be the previous layer's outputs, in which case
+                inputs aren't copied
+            */
+            if (ownsBuffers) {
+                delete[] inputs;
+                delete[] gradient;
+                delete[] outputs;
+                ownsBuffers = false;
+            }
+            inputs = _inputs;
+            outputs = _outputs;
+            gradient = _gradient;
         }
 
 
         virtual void forward(const double* functionInputs) {}
 
+        virtual void forwardBatch(const double* functionInputs, unsigned int batchSize, double* batchOutputs) {
+            /*
+                inference on batchSize samples stored one after another
+                the default runs forward on every sample
+            */
+            for (unsigned int sample = 0; sample < batchSize; sample++) {
+                forward(functionInputs + sample * inputsNumber);
+                std::memcpy(batchOutputs + sample * inputsNumber, outputs, inputsNumber * sizeof(double));
+            }
+        }
+
         virtual void backward(const double* outputGradient) {}
 
         void printOutputs() const {
@@ -46,23 +81,57 @@ namespace Activations {
         unsigned int inputsNumber;
         double* gradient;
         double* outputs;
+        bool ownsBuffers;
 
         OutputActivation(unsigned int _inputsNumber) 
-        : inputsNumber(_inputsNumber)
+        : inputsNumber(_inputsNumber),
+          ownsBuffers(true)
         {
             inputs = new double[inputsNumber];
             gradient = new double[inputsNumber];
             outputs = new double[inputsNumber];
         };
 
-        ~OutputActivation() {
-            delete[] inputs;
-            delete[] gradient;
-            delete[] outputs;
+        virtual ~OutputActivation() {
+            if (ownsBuffers) {
+                delete[] inputs;
+                delete[] gradient;
+                delete[] outputs;
+            }
+        }
+
+
+        void bindBuffers(double* _inputs, double* _outputs, double* _gradient) {
+            /*
+                replaces the activation's own buffers with buffers owned
+                by someone else (see MemoryPlan)
+                _inputs can be the previous layer's outputs, in which case
+                inputs aren't copied
+            */
+            if (ownsBuffers) {
+                delete[] inputs;
+                delete[] gradient;
+                delete[] outputs;
+                ownsBuffers = false;
+            }
+            inputs = _inputs;
+            outputs = _outputs;
+            gradient = _gradient;
         }
 
         virtual void forward(const double* functionInputs) {}
 
+        virtual void forwardBatch(const double* functionInputs, unsigned int batchSize, double* batchOutputs) {
+            /*
+                inference on batchSize samples stored one after another
+                the default runs forward on every sample
+            */
+            for (unsigned int sample = 0; sample < batchSize; sample++) {
+                forward(functionInputs + sample * inputsNumber);
+                std::memcpy(batchOutputs + sample * inputsNumber, outputs, inputsNumber * sizeof(double));
+            }
+        }
+
         virtual void backward(const double* outputGradient) {}
 
         void printOutputs() const {
@@ -90,12 +159,21 @@ namespace Activations {
             */
             for (unsigned int input = 0; input < inputsNumber; input++) {
                 // copying inputs for backpropagation
-                inputs[input] = reluInput[input];
+                if (inputs != reluInput) {
+                    inputs[input] = reluInput[input];
+                }
                 // output = input * [0/1] based on result of (input > 0)
                 outputs[input] = reluInput[input] * (reluInput[input] > 0);
             }
         }
 
+        void forwardBatch(const double* reluInputs, unsigned int batchSize, double* batchOutputs) override {
+            // inputs don't need to be kept for inference
+            for (unsigned int value = 0; value < batchSize * inputsNumber; value++) {
+                batchOutputs[value] = reluInputs[value] * (reluInputs[value] > 0);
+            }
+        }
+
         void backward(const double* outputGradient) override {
             /*
                 iterate through relu's gradient
@@ -147,7 +225,9 @@ namespace Activations {
             double biggestValue = smInputs[0];
             for (unsigned int input = 0; input < inputsNumber; input ++) {
                 // copy inputs for backpropagation
-                inputs[input] = smInputs[input];
+                if (inputs != smInputs) {
+                    inputs[input] = smInputs[input];
+                }
                 if (smInputs[input] > biggestValue) {
                     biggestValue = smInputs[input];
                 }
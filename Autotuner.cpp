@@ -0,0 +1,193 @@
+#pragma once
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <map>
+#include <chrono>
+#include <thread>
+#include "DenseLayer.cpp"
+
+
+class Autotuner {
+    /*
+        picks the fastest KernelConfig for every layer shape
+        (inputsNumber x neuronsNumber) by benchmarking forward + backward
+        of every candidate configuration on this machine
+        winners are kept in a tuning cache file, one line per entry:
+            cpu model<TAB>inputs neurons blockSize unroll threads
+        so later runs on the same CPU don't benchmark again
+    */
+private:
+
+    std::string cacheFile;
+    std::string cpu;
+
+    // "inputs neurons" -> best configuration for this cpu
+    std::map<std::string, KernelConfig> configs;
+
+    unsigned int repetitions;
+
+
+public:
+
+    // --------- CONSTRUCTOR / DESTRUCTOR
+
+    Autotuner(const char* _cacheFile, unsigned int _repetitions = 50)
+    : cacheFile(_cacheFile),
+      repetitions(_repetitions)
+    {
+        cpu = cpuModel();
+        loadCache();
+    }
+
+
+    // -------- FUNCTIONS
+
+    KernelConfig tune(unsigned int inputsNumber, unsigned int neuronsNumber) {
+        // returns the cached configuration or benchmarks the candidates
+        std::string key = shapeKey(inputsNumber, neuronsNumber);
+        std::map<std::string, KernelConfig>::iterator cached = configs.find(key);
+        if (cached != configs.end()) {
+            return cached->second;
+        }
+
+        KernelConfig best = benchmark(inputsNumber, neuronsNumber);
+        configs[key] = best;
+        storeEntry(key, best);
+        return best;
+    }
+
+
+    void tune(DenseLayer* layer) {
+        layer->kernel = tune(layer->inputsNumber, layer->neuronsNumber);
+    }
+
+
+    const std::string& getCpuModel() const {
+        return cpu;
+    }
+
+
+private:
+
+    KernelConfig benchmark(unsigned int inputsNumber, unsigned int neuronsNumber) const {
+        /*
+            candidates: whole rows or cache blocks smaller than a row,
+            1, 2 or 4 neurons per pass and up to one thread per core
+            every candidate is timed on a scratch layer of the same
+            shape, the best of 3 trials is kept to reduce noise
+        */
+        DenseLayer layer(inputsNumber, neuronsNumber);
+        double* inputs = new double[inputsNumber];
+        double* gradient = new double[neuronsNumber];
+        for (unsigned int input = 0; input < inputsNumber; input++) {
+            inputs[input] = (rand() % 19 + (-9)) * 0.1;
+        }
+        for (unsigned int neuron = 0; neuron < neuronsNumber; neuron++) {
+            gradient[neuron] = (rand() % 19 + (-9)) * 0.1;
+        }
+
+        const unsigned int blockSizes[] = {0, 32, 128, 512};
+        const unsigned int unrolls[] = {1, 2, 4};
+        unsigned int cores = std::thread::hardware_concurrency();
+        if (cores == 0) {
+            cores = 1;
+        }
+
+        KernelConfig best = {0, 1, 1};
+        double bestTime = -1;
+
+        for (unsigned int blockSize : blockSizes) {
+            if (blockSize >= inputsNumber) {
+                continue;
+            }
+            for (unsigned int unroll : unrolls) {
+                if (unroll > neuronsNumber) {
+                    continue;
+                }
+                for (unsigned int threads = 1; threads <= cores && threads <= neuronsNumber; threads *= 2) {
+                    layer.kernel = {blockSize, unroll, threads};
+
+                    double time = -1;
+                    for (unsigned int trial = 0; trial < 3; trial++) {
+                        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                        for (unsigned int repetition = 0; repetition < repetitions; repetition++) {
+                            layer.forward(inputs);
+                            layer.backward(gradient);
+                        }
+                        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                        if (time < 0 || elapsed < time) {
+                            time = elapsed;
+                        }
+                    }
+
+                    if (bestTime < 0 || time < bestTime) {
+                        bestTime = time;
+                        best = layer.kernel;
+                    }
+                }
+            }
+        }
+
+        delete[] inputs;
+        delete[] gradient;
+        return best;
+    }
+
+
+    static std::string shapeKey(unsigned int inputsNumber, unsigned int neuronsNumber) {
+        return std::to_string(inputsNumber) + " " + std::to_string(neuronsNumber);
+    }
+
+
+    static std::string cpuModel() {
+        // cpu model name and number of cores, the cache is only valid for both
+        std::ifstream file("/proc/cpuinfo");
+        std::string line;
+        std::string model = "unknown";
+        while (std::getline(file, line)) {
+            if (line.compare(0, 10, "model name") == 0) {
+                // the value after the colon, trimmed (it may be empty)
+                std::string::size_type colon = line.find(':');
+                if (colon != std::string::npos) {
+                    std::string::size_type first = line.find_first_not_of(" \t", colon + 1);
+                    std::string::size_type last = line.find_last_not_of(" \t");
+                    if (first != std::string::npos && last > colon) {
+                        model = line.substr(first, last - first + 1);
+                    }
+                }
+                break;
+            }
+        }
+        return model + " x" + std::to_string(std::thread::hardware_concurrency());
+    }
+
+
+    void loadCache() {
+        // only the entries of this cpu are kept, later entries win
+        std::ifstream file(cacheFile);
+        std::string line;
+        while (std::getline(file, line)) {
+            std::string::size_type tab = line.find('\t');
+            if (tab == std::string::npos || line.substr(0, tab) != cpu) {
+                continue;
+            }
+
+            std::istringstream entry(line.substr(tab + 1));
+            unsigned int inputsNumber, neuronsNumber;
+            KernelConfig config;
+            if (entry >> inputsNumber >> neuronsNumber >> config.blockSize >> config.unroll >> config.threads) {
+                configs[shapeKey(inputsNumber, neuronsNumber)] = config;
+            }
+        }
+    }
+
+
+    void storeEntry(const std::string& key, const KernelConfig& config) const {
+        std::ofstream file(cacheFile, std::ios::app);
+        file << cpu << "\t" << key << " " << config.blockSize << " "
+             << config.unroll << " " << config.threads << "\n";
+    }
+
+};
@@ -0,0 +1,226 @@
+#pragma once
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cerrno>
+#include <unistd.h>
+
+
+class Checkpointer {
+    /*
+        takes non-blocking checkpoints of a network
+        the training thread only copies the network's state in one
+        of two buffers (between two training steps), a background
+        thread writes it to disk with an atomic rename and keeps
+        only the last retained checkpoints
+        files have the same format as Network::store, so they can
+        be loaded back with Network::load
+        the state size is taken again at every checkpoint, so layers
+        replaced in the meantime (factorizeLayer, pruneLayer) are
+        stored with their own layout
+    */
+private:
+
+    std::string prefix;
+    unsigned int retained;
+
+    // double buffer: one can be written to disk while the other is filled
+    double* buffers[2];
+    unsigned int capacities[2];
+    unsigned int sizes[2];
+    unsigned long steps[2];
+
+    // index of the buffer waiting to be written / being written, -1 if none
+    int pending;
+    int writing;
+    bool stopping;
+
+    // checkpoints that couldn't be written, and why the last one failed
+    unsigned int failures;
+    std::string lastError;
+
+    std::deque<std::string> written;
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::thread writer;
+
+
+public:
+
+    // --------- CONSTRUCTOR / DESTRUCTOR
+
+    Checkpointer(
+        const char* _prefix,
+        unsigned int _stateSize,
+        unsigned int _retained
+        )
+    : prefix(_prefix),
+      retained(_retained > 0 ? _retained : 1),
+      pending(-1),
+      writing(-1),
+      stopping(false),
+      failures(0)
+    {
+        // _stateSize is only the initial size, buffers grow with the network's state
+        for (unsigned int buffer = 0; buffer < 2; buffer++) {
+            buffers[buffer] = new double[_stateSize];
+            capacities[buffer] = _stateSize;
+            sizes[buffer] = 0;
+        }
+
+        writer = std::thread(&Checkpointer::writeLoop, this);
+    }
+
+
+    ~Checkpointer() {
+        // the last pending checkpoint is still written before stopping
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_all();
+        writer.join();
+
+        delete[] buffers[0];
+        delete[] buffers[1];
+    }
+
+
+    // -------- FUNCTIONS
+
+    template <typename NetworkType>
+    void checkpoint(const NetworkType& network, unsigned long step) {
+        /*
+            copies the network's state and returns immediately
+            must be called between training steps
+            if the previous checkpoint hasn't been picked up by the
+            writer yet, it's replaced by this one
+        */
+        int buffer;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            // take back the pending buffer so the writer can't read it while it's copied
+            pending = -1;
+            buffer = writing == 0 ? 1 : 0;
+        }
+
+        // the writer never reads this buffer now, it can be reallocated
+        unsigned int size = network.getStateSize();
+        if (size > capacities[buffer]) {
+            delete[] buffers[buffer];
+            buffers[buffer] = new double[size];
+            capacities[buffer] = size;
+        }
+        network.saveState(buffers[buffer]);
+        sizes[buffer] = size;
+        steps[buffer] = step;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending = buffer;
+        }
+        condition.notify_all();
+    }
+
+
+    bool wait() {
+        /*
+            blocks until every checkpoint taken so far has been written
+            returns false if any checkpoint failed to be written
+        */
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [this] {return pending == -1 && writing == -1;});
+        return failures == 0;
+    }
+
+
+    unsigned int getFailures() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return failures;
+    }
+
+
+    std::string getLastError() {
+        // empty if no checkpoint failed
+        std::lock_guard<std::mutex> lock(mutex);
+        return lastError;
+    }
+
+
+    std::string fileName(unsigned long step) const {
+        return prefix + "." + std::to_string(step) + ".ckpt";
+    }
+
+
+private:
+
+    void writeLoop() {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        while (true) {
+            condition.wait(lock, [this] {return pending != -1 || stopping;});
+            if (pending == -1) {
+                return;
+            }
+
+            writing = pending;
+            pending = -1;
+            lock.unlock();
+
+            std::string error = write(buffers[writing], sizes[writing], steps[writing]);
+
+            lock.lock();
+            if (!error.empty()) {
+                failures++;
+                lastError = error;
+            }
+            writing = -1;
+            // wake up wait()
+            condition.notify_all();
+        }
+    }
+
+
+    std::string write(const double* state, unsigned int stateSize, unsigned long step) {
+        /*
+            writes to a temporary file and renames it, so a checkpoint
+            file is either complete or missing
+            returns an error message, empty on success
+        */
+        std::string name = fileName(step);
+        std::string temporary = name + ".tmp";
+
+        FILE* file = fopen(temporary.c_str(), "wb");
+        if (file == NULL) {
+            return "can't open " + temporary + ": " + strerror(errno);
+        }
+
+        bool ok = fwrite(&stateSize, sizeof(stateSize), 1, file) == 1
+            && fwrite(state, sizeof(double), stateSize, file) == stateSize
+            && fflush(file) == 0
+            && fsync(fileno(file)) == 0;
+        ok = fclose(file) == 0 && ok;
+
+        if (!ok || rename(temporary.c_str(), name.c_str()) != 0) {
+            std::string error = "can't write " + name + ": " + strerror(errno);
+            remove(temporary.c_str());
+            return error;
+        }
+
+        // only the writer thread touches the list of written checkpoints
+        if (written.empty() || written.back() != name) {
+            written.push_back(name);
+        }
+        while (written.size() > retained) {
+            remove(written.front().c_str());
+            written.pop_front();
+        }
+        return "";
+    }
+
+};
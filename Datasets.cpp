@@ -1,4 +1,18 @@
 #pragma once
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <random>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 
 namespace Datasets {
@@ -11,6 +25,8 @@ namespace Datasets {
         Dataset(unsigned int _size) 
         : size(_size) {}
 
+        virtual ~Dataset() {}
+
         virtual void store(const char* fileName) {}
 
         virtual void load(const char* fileName) {}
@@ -18,5 +34,435 @@ namespace Datasets {
     };
 
 
-    
+    /*
+        binary shard format, every shard is a file <prefix>.<index>.shard:
+            ShardHeader (64 bytes)
+            rows * rowStride floats, every row padded to 64 bytes
+            rows unsigned 32 bit labels
+    */
+    const char shardMagic[4] = {'N', 'N', 'D', 'S'};
+    const unsigned int shardVersion = 1;
+    const unsigned int shardAlignment = 64;
+
+    struct ShardHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t featuresNumber;
+        uint32_t rowStride;         // floats per row, featuresNumber rounded up to 64 bytes
+        uint64_t rows;
+        uint64_t featuresOffset;
+        uint64_t labelsOffset;
+        char padding[24];
+    };
+
+
+    inline std::string shardName(const char* prefix, unsigned int shard) {
+        return std::string(prefix) + "." + std::to_string(shard) + ".shard";
+    }
+
+
+    inline unsigned int convertText(
+        const char* textFile,
+        const char* prefix,
+        unsigned int featuresNumber,
+        unsigned int rowsPerShard,
+        std::string* error = NULL
+        ) {
+        /*
+            converts a whitespace separated text dataset (featuresNumber
+            values and a label per line, like set.txt) in binary shards
+            of at most rowsPerShard rows, blank lines are skipped
+            every shard is written to a temporary file and renamed once
+            complete, so a shard file is either complete or missing
+            shards left by an older conversion to the same prefix are removed
+            returns the number of shards written, if the text file can't
+            be read, a line isn't a sample or a shard can't be written
+            the conversion stops there (the shard being written is
+            dropped) and error (if given) says why, it's left empty
+            on success
+        */
+        if (error != NULL) {
+            error->clear();
+        }
+        std::ifstream text(textFile);
+        if (!text) {
+            if (error != NULL) {
+                *error = std::string("can't open ") + textFile + ": " + strerror(errno);
+            }
+            return 0;
+        }
+
+        ShardHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, shardMagic, sizeof(shardMagic));
+        header.version = shardVersion;
+        header.featuresNumber = featuresNumber;
+        const unsigned int floatsPerBlock = shardAlignment / sizeof(float);
+        header.rowStride = (featuresNumber + floatsPerBlock - 1) / floatsPerBlock * floatsPerBlock;
+        header.featuresOffset = sizeof(ShardHeader);
+
+        float* row = new float[header.rowStride];
+        std::memset(row, 0, header.rowStride * sizeof(float));
+        std::vector<uint32_t> labels;
+        labels.reserve(rowsPerShard);
+
+        unsigned int shards = 0;
+        FILE* shard = NULL;
+        std::string name;
+        std::string temporary;
+        std::string failure;
+
+        std::string line;
+        unsigned long lineNumber = 0;
+        bool reading = true;
+
+        while (reading && failure.empty()) {
+            reading = (bool) std::getline(text, line);
+
+            if (reading) {
+                lineNumber++;
+                if (line.find_first_not_of(" \t\r") == std::string::npos) {
+                    continue;
+                }
+
+                std::istringstream sample(line);
+                double value;
+                unsigned int hotOne;
+                std::string rest;
+                unsigned int feature = 0;
+                for (; feature < featuresNumber && sample >> value; feature++) {
+                    row[feature] = (float) value;
+                }
+                if (feature < featuresNumber || !(sample >> hotOne) || sample >> rest) {
+                    failure = std::string(textFile) + ":" + std::to_string(lineNumber) + ": expected "
+                        + std::to_string(featuresNumber) + " values and a label";
+                }
+
+                if (failure.empty() && shard == NULL) {
+                    name = shardName(prefix, shards);
+                    temporary = name + ".tmp";
+                    shard = fopen(temporary.c_str(), "wb");
+                    if (shard == NULL) {
+                        failure = "can't open " + temporary + ": " + strerror(errno);
+                    }
+                    // an empty shard until the header is rewritten with the rows
+                    header.rows = 0;
+                    header.labelsOffset = header.featuresOffset;
+                    if (shard != NULL && fwrite(&header, sizeof(header), 1, shard) != 1) {
+                        failure = "can't write " + temporary + ": " + strerror(errno);
+                    }
+                }
+                if (failure.empty()) {
+                    if (fwrite(row, sizeof(float), header.rowStride, shard) != header.rowStride) {
+                        failure = "can't write " + temporary + ": " + strerror(errno);
+                    }
+                    labels.push_back(hotOne);
+                }
+            }
+
+            if (shard != NULL && !failure.empty()) {
+                fclose(shard);
+                remove(temporary.c_str());
+                shard = NULL;
+            }
+
+            if (shard != NULL && (!reading || labels.size() == rowsPerShard)) {
+                header.rows = labels.size();
+                header.labelsOffset = header.featuresOffset + header.rows * header.rowStride * sizeof(float);
+                bool ok = fwrite(labels.data(), sizeof(uint32_t), labels.size(), shard) == labels.size()
+                    && fseek(shard, 0, SEEK_SET) == 0
+                    && fwrite(&header, sizeof(header), 1, shard) == 1;
+                ok = fclose(shard) == 0 && ok;
+
+                if (!ok || rename(temporary.c_str(), name.c_str()) != 0) {
+                    failure = "can't write " + name + ": " + strerror(errno);
+                    remove(temporary.c_str());
+                }
+                else {
+                    shards++;
+                }
+
+                shard = NULL;
+                labels.clear();
+            }
+        }
+
+        if (failure.empty() && text.bad()) {
+            failure = std::string("can't read ") + textFile;
+        }
+
+        // shards of an older conversion to the same prefix would be loaded after these
+        for (unsigned int stale = shards; remove(shardName(prefix, stale).c_str()) == 0; stale++) {}
+        if (error != NULL) {
+            *error = failure;
+        }
+
+        delete[] row;
+        return shards;
+    }
+
+
+    inline bool validShard(const ShardHeader& header, uint64_t fileSize) {
+        /*
+            checks that the header describes a shard that fits in a file
+            of fileSize bytes, so rows can be read without going past it
+        */
+        if (fileSize < sizeof(ShardHeader)
+            || std::memcmp(header.magic, shardMagic, sizeof(shardMagic)) != 0
+            || header.version != shardVersion
+            || header.featuresNumber == 0
+            || header.rowStride < header.featuresNumber
+            || header.featuresOffset < sizeof(ShardHeader)
+            || header.featuresOffset % sizeof(float) != 0
+            || header.labelsOffset % sizeof(uint32_t) != 0
+            || header.featuresOffset > fileSize
+            || header.labelsOffset > fileSize) {
+            return false;
+        }
+        // checked by division first so the products below can't overflow
+        if (header.rows > fileSize / sizeof(uint32_t)
+            || (header.rows > 0 && header.rowStride > fileSize / sizeof(float) / header.rows)) {
+            return false;
+        }
+        return header.featuresOffset + header.rows * header.rowStride * sizeof(float) <= header.labelsOffset
+            && header.labelsOffset + header.rows * sizeof(uint32_t) <= fileSize;
+    }
+
+
+    struct ShardedDataset : public Dataset {
+        /*
+            streams binary shards from disk without loading them:
+            one shard at a time is mmap'ed, the pages ahead of the
+            reading position are requested with madvise and the ones
+            already read are released
+            every epoch visits the shards in random order, and the rows
+            of a shard in a random order within a window of
+            shuffleWindow rows
+        */
+        std::vector<std::string> shards;
+        unsigned int featuresNumber;
+
+        unsigned int shuffleWindow;
+        std::mt19937 generator;
+
+        // current shard
+        unsigned int shardIndex;
+        std::vector<unsigned int> order;
+        int file;
+        unsigned char* mapping;
+        size_t mappingSize;
+        const ShardHeader* header;
+
+        // rows of the current shard waiting in the shuffle window
+        std::vector<uint64_t> window;
+        uint64_t nextRow;
+        uint64_t advisedUntil;
+
+        // bytes requested ahead of the reading position
+        static const size_t readAhead = 8 << 20;
+
+
+        ShardedDataset(unsigned int _shuffleWindow, unsigned int seed)
+        : Dataset(0),
+          featuresNumber(0),
+          shuffleWindow(_shuffleWindow > 0 ? _shuffleWindow : 1),
+          generator(seed),
+          shardIndex(0),
+          file(-1),
+          mapping(NULL),
+          mappingSize(0),
+          header(NULL),
+          nextRow(0),
+          advisedUntil(0)
+        {
+            set = NULL;
+        }
+
+
+        ~ShardedDataset() {
+            unmap();
+        }
+
+
+        void load(const char* prefix) override {
+            /*
+                finds the shards <prefix>.0.shard, <prefix>.1.shard, ...
+                size is the total number of rows (0 if no valid shard is found)
+            */
+            unmap();
+            shards.clear();
+            size = 0;
+            featuresNumber = 0;
+
+            for (unsigned int shard = 0; ; shard++) {
+                std::string name = shardName(prefix, shard);
+                std::ifstream file(name, std::ios::binary);
+                ShardHeader shardHeader;
+                struct stat status;
+                if (!file.read((char*) &shardHeader, sizeof(shardHeader))
+                    || stat(name.c_str(), &status) != 0
+                    || !validShard(shardHeader, status.st_size)
+                    || (featuresNumber != 0 && shardHeader.featuresNumber != featuresNumber)) {
+                    break;
+                }
+                featuresNumber = shardHeader.featuresNumber;
+                size += shardHeader.rows;
+                shards.push_back(name);
+            }
+
+            rewind();
+        }
+
+
+        void rewind() {
+            // starts a new epoch
+            unmap();
+            order.resize(shards.size());
+            for (unsigned int shard = 0; shard < shards.size(); shard++) {
+                order[shard] = shard;
+            }
+            std::shuffle(order.begin(), order.end(), generator);
+            shardIndex = 0;
+        }
+
+
+        bool next(double* features, unsigned int& hotOne) {
+            /*
+                reads the next sample of the epoch in features (featuresNumber
+                values) and hotOne, returns false at the end of the epoch
+            */
+            while (window.empty()) {
+                if (mapping != NULL) {
+                    unmap();
+                    shardIndex++;
+                }
+                if (shardIndex >= order.size()) {
+                    return false;
+                }
+                if (!map(shards[order[shardIndex]])) {
+                    // unreadable shard, skipped
+                    shardIndex++;
+                    continue;
+                }
+                fillWindow();
+            }
+
+            // take a random row of the window and replace it with the next one
+            unsigned int slot = generator() % window.size();
+            uint64_t row = window[slot];
+            if (nextRow < header->rows) {
+                window[slot] = nextRow++;
+                adviseAhead();
+            }
+            else {
+                window[slot] = window.back();
+                window.pop_back();
+            }
+
+            const float* rowFeatures = (const float*) (mapping + header->featuresOffset)
+                + row * header->rowStride;
+            for (unsigned int feature = 0; feature < featuresNumber; feature++) {
+                features[feature] = rowFeatures[feature];
+            }
+            hotOne = ((const uint32_t*) (mapping + header->labelsOffset))[row];
+            return true;
+        }
+
+
+        unsigned int getFeaturesNumber() const {
+            return featuresNumber;
+        }
+
+
+    private:
+
+        bool map(const std::string& name) {
+            file = open(name.c_str(), O_RDONLY);
+            struct stat status;
+            if (file < 0 || fstat(file, &status) != 0) {
+                unmap();
+                return false;
+            }
+
+            // the shard may have changed since load
+            ShardHeader shardHeader;
+            if (pread(file, &shardHeader, sizeof(shardHeader), 0) != (ssize_t) sizeof(shardHeader)
+                || !validShard(shardHeader, status.st_size)
+                || shardHeader.featuresNumber != featuresNumber) {
+                unmap();
+                return false;
+            }
+
+            mappingSize = status.st_size;
+            void* address = mmap(NULL, mappingSize, PROT_READ, MAP_PRIVATE, file, 0);
+            if (address == MAP_FAILED) {
+                unmap();
+                return false;
+            }
+            mapping = (unsigned char*) address;
+            header = (const ShardHeader*) mapping;
+            madvise(mapping, mappingSize, MADV_SEQUENTIAL);
+
+            nextRow = 0;
+            advisedUntil = 0;
+            adviseAhead();
+            return true;
+        }
+
+
+        void unmap() {
+            if (mapping != NULL) {
+                munmap(mapping, mappingSize);
+            }
+            if (file >= 0) {
+                close(file);
+            }
+            mapping = NULL;
+            mappingSize = 0;
+            header = NULL;
+            file = -1;
+            window.clear();
+        }
+
+
+        void fillWindow() {
+            if (mapping == NULL) {
+                return;
+            }
+            while (window.size() < shuffleWindow && nextRow < header->rows) {
+                window.push_back(nextRow++);
+            }
+        }
+
+
+        void adviseAhead() {
+            /*
+                keeps readAhead bytes requested in front of the reading
+                position and releases the pages behind the shuffle window
+            */
+            const size_t rowBytes = header->rowStride * sizeof(float);
+            const size_t position = header->featuresOffset + nextRow * rowBytes;
+            const size_t page = sysconf(_SC_PAGESIZE);
+
+            if (position + readAhead / 2 > advisedUntil && advisedUntil < mappingSize) {
+                size_t from = advisedUntil / page * page;
+                size_t until = std::min(position + readAhead, mappingSize);
+                madvise(mapping + from, until - from, MADV_WILLNEED);
+                advisedUntil = until;
+
+                // rows before the oldest one in the window won't be read again
+                uint64_t oldest = nextRow;
+                for (uint64_t row : window) {
+                    oldest = std::min(oldest, row);
+                }
+                size_t done = (header->featuresOffset + oldest * rowBytes) / page * page;
+                if (done > page) {
+                    madvise(mapping + page, done - page, MADV_DONTNEED);
+                }
+            }
+        }
+
+    };
+
+
 };
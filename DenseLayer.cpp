@@ -1,6 +1,24 @@
 #pragma once
 #include <iostream>
+#include <cstring>
+#include <thread>
+#include <chrono>
 #include "Activations.cpp"
+#include "WorkerPool.cpp"
+
+
+struct KernelConfig {
+    /*
+        how DenseLayer's forward and backward loops are run
+        blockSize: inputs processed per cache block (0 = whole row)
+        unroll: neurons processed together (1, 2 or 4)
+        threads: threads the neurons (or inputs) are split among
+    */
+    unsigned int blockSize;
+    unsigned int unroll;
+    unsigned int threads;
+};
+
 
 class DenseLayer {
 
@@ -20,6 +38,11 @@ public:
     double* biasesGradient;
     double* inputsGradient;
 
+    // false when outputs, layerInputs and inputsGradient are bound to a shared slab
+    bool ownsBuffers;
+
+    KernelConfig kernel;
+
     // --------- CONSTRUCTOR / DESTRUCTOR
 
     DenseLayer();
@@ -29,69 +52,95 @@ public:
         unsigned int _inputsNumber,
         unsigned int _neuronsNumber
         )
-    : inputsNumber(_inputsNumber),
-      neuronsNumber(_neuronsNumber)
-    {
-        weights = new double*[neuronsNumber];
-        biases = new double[neuronsNumber];
+    : DenseLayer(_inputsNumber, _neuronsNumber, true) {}
 
-        outputs = new double[neuronsNumber];
 
-        layerInputs = new double[inputsNumber];
-        weightsGradients = new double*[neuronsNumber];
-        biasesGradient = new double[neuronsNumber];
-        inputsGradient = new double[inputsNumber];
+    virtual ~DenseLayer() {
 
-        
-        // create 2 dimensional array for weights
-        for (unsigned int neuron = 0; neuron < neuronsNumber; neuron++) {
-            weights[neuron] = new double[inputsNumber];
-            biases[neuron] = 0;
-            weightsGradients[neuron] = new double[inputsNumber];
-            for (unsigned int input = 0; input < inputsNumber; input++) {
-                weights[neuron][input] = (rand() % 19 + (-9)) * 0.1;
+        if (weights != NULL) {
+            for (unsigned int neuron = 0; neuron < neuronsNumber; neuron ++) {
+                delete[] weights[neuron];
+                delete[] weightsGradients[neuron];
             }
         }
-    }
-
 
-    ~DenseLayer() {
-
-        for (unsigned int neuron = 0; neuron < neuronsNumber; neuron ++) {
-            delete[] weights[neuron];
-            delete[] weightsGradients[neuron];
-        }
+        delete workers;
 
         delete[] biases;
         delete[] weights;
-        delete[] outputs;
-        delete[] layerInputs;
         delete[] weightsGradients;
         delete[] biasesGradient;
-        delete[] inputsGradient;
+
+        if (ownsBuffers) {
+            delete[] outputs;
+            delete[] layerInputs;
+            delete[] inputsGradient;
+        }
 
     }
 
+
+    void bindBuffers(double* _outputs, double* _layerInputs, double* _inputsGradient) {
+        /*
+            replaces the layer's own activation buffers with
+            buffers owned by someone else (see MemoryPlan)
+            _layerInputs can be the previous activation's outputs, in which
+            case inputs aren't copied, or NULL if the layer is only used
+            for inference
+        */
+        if (ownsBuffers) {
+            delete[] outputs;
+            delete[] layerInputs;
+            delete[] inputsGradient;
+            ownsBuffers = false;
+        }
+        outputs = _outputs;
+        layerInputs = _layerInputs;
+        inputsGradient = _inputsGradient;
+    }
+
     // -------- FUNCTIONS
 
     
 
     virtual void forward(const double *inputs) {
         // copying inputs for backpropagation
-        for (unsigned int input = 0; input < inputsNumber; input++) {
-            layerInputs[input] = inputs[input];
+        if (layerInputs != NULL && layerInputs != inputs) {
+            for (unsigned int input = 0; input < inputsNumber; input++) {
+                layerInputs[input] = inputs[input];
+            }
         }
         // activation function(inputs * weights + bias)
-        for (unsigned int neuron = 0; neuron < neuronsNumber; neuron++) {
-            // multiplying by weights
-            for (unsigned int input = 0; input < inputsNumber; input++) {
-                outputs[neuron] += inputs[input] * weights[neuron][input];
+        parallelFor(neuronsNumber, [this, inputs](unsigned int first, unsigned int last) {
+            switch (kernel.unroll) {
+                case 4: forwardNeurons<4>(inputs, first, last); break;
+                case 2: forwardNeurons<2>(inputs, first, last); break;
+                default: forwardNeurons<1>(inputs, first, last); break;
             }
-            // adding bias
-            outputs[neuron] += biases[neuron];
+        });
+    }
 
-        }
 
+    virtual void forwardBatch(const double* inputs, unsigned int batchSize, double* batchOutputs) {
+        /*
+            inference on batchSize samples stored one after another
+            (inputsNumber values per sample, neuronsNumber outputs per sample)
+            every row of weights is used by the whole batch while it's in cache
+            inputs aren't copied, so backward can't follow
+        */
+        parallelFor(neuronsNumber, [this, inputs, batchSize, batchOutputs](unsigned int first, unsigned int last) {
+            for (unsigned int neuron = first; neuron < last; neuron++) {
+                const double* neuronWeights = weights[neuron];
+                for (unsigned int sample = 0; sample < batchSize; sample++) {
+                    const double* sampleInputs = inputs + sample * inputsNumber;
+                    double sum = biases[neuron];
+                    for (unsigned int input = 0; input < inputsNumber; input++) {
+                        sum += sampleInputs[input] * neuronWeights[input];
+                    }
+                    batchOutputs[sample * neuronsNumber + neuron] = sum;
+                }
+            }
+        });
     }
 
 
@@ -101,33 +150,92 @@ public:
             and biases
             here is called the backward method of activation functions
             takes as argument the gradient of its output (input of its activation function)
+            weights and biases gradients are split among threads by neuron,
+            the inputs gradient by input
         */
-
-        for (unsigned int neuron = 0; neuron < neuronsNumber; neuron++) {
-            for (unsigned int weight = 0; weight < inputsNumber; weight++) {
+        parallelFor(neuronsNumber, [this, activationGradient](unsigned int first, unsigned int last) {
+            for (unsigned int neuron = first; neuron < last; neuron++) {
+                for (unsigned int weight = 0; weight < inputsNumber; weight++) {
+                    /*
+                        following the chain rule:
+                            multiply the partial derivatives (layerInputs[weight] * outputGradient[neuron])
+                            the partial derivative of a weight is its input since the partial
+                            derivative of x multiplied by y is y ( f(x) = x*y --> f'(x) = y )
+                    */
+                    weightsGradients[neuron][weight] = layerInputs[weight] * activationGradient[neuron];
+                }
                 /*
+                    calculate the bias' impact on loss function
+                    the partial derivative of weighted sum (i * w + b) with respect to the bias
+                    is int 1 since the partial derivative of a sum is 1 and the bias is summed
                     following the chain rule:
-                        multiply the partial derivatives (layerInputs[weight] * outputGradient[neuron])
-                        the partial derivative of a weight is its input since the partial
-                        derivative of x multiplied by y is y ( f(x) = x*y --> f'(x) = y )
+                        the impact of the bias on the loss function is calculated
+                        by multiplying its partial derivative on the neuron's output
+                        by the partial derivative of the neuron's output on the loss function (outputGradient[neuron])
                 */
-                weightsGradients[neuron][weight] = layerInputs[weight] * activationGradient[neuron];
+                biasesGradient[neuron] = activationGradient[neuron];
+            }
+        });
+
+        // calculate the inputs' impact on the network
+        parallelFor(inputsNumber, [this, activationGradient](unsigned int first, unsigned int last) {
+            switch (kernel.unroll) {
+                case 4: backwardInputs<4>(activationGradient, first, last); break;
+                case 2: backwardInputs<2>(activationGradient, first, last); break;
+                default: backwardInputs<1>(activationGradient, first, last); break;
+            }
+        });
+
+    }
+
 
-                // calculate the neuron's impact on the network
-                inputsGradient[neuron] += activationGradient[neuron] * weights[neuron][weight];
+    virtual void applyGradients(double learningRate) {
+        /*
+            moves every parameter against its gradient (SGD step)
+            layers storing their weights differently override it
+        */
+        // changing weights
+        for (unsigned int neuron = 0; neuron < neuronsNumber; neuron++) {
+            for (unsigned int weight = 0; weight < inputsNumber; weight++) {
+                weights[neuron][weight] -= learningRate * weightsGradients[neuron][weight];
             }
-            /*
-                calculate the bias' impact on loss function
-                the partial derivative of weighted sum (i * w + b) with respect to the bias
-                is int 1 since the partial derivative of a sum is 1 and the bias is summed
-                following the chain rule:
-                    the impact of the bias on the loss function is calculated
-                    by multiplying its partial derivative on the neuron's output
-                    by the partial derivative of the neuron's output on the loss function (outputGradient[neuron])
-            */
-            biasesGradient[neuron] = activationGradient[neuron];
         }
+        // changing biases
+        for (unsigned int bias = 0; bias < neuronsNumber; bias++) {
+            biases[bias] -= learningRate * biasesGradient[bias];
+        }
+    }
+
+
+    bool isDense() const {
+        // false for layers without the full weights matrix (e.g. LowRankLayer)
+        return weights != NULL;
+    }
+
 
+    virtual unsigned int parametersNumber() const {
+        // number of doubles written by saveParameters
+        return neuronsNumber * inputsNumber + neuronsNumber;
+    }
+
+
+    virtual void saveParameters(double* to) const {
+        // copies weights (row by row) and then biases into a flat array
+        for (unsigned int neuron = 0; neuron < neuronsNumber; neuron++) {
+            std::memcpy(to, weights[neuron], inputsNumber * sizeof(double));
+            to += inputsNumber;
+        }
+        std::memcpy(to, biases, neuronsNumber * sizeof(double));
+    }
+
+
+    virtual void loadParameters(const double* from) {
+        // inverse of saveParameters
+        for (unsigned int neuron = 0; neuron < neuronsNumber; neuron++) {
+            std::memcpy(weights[neuron], from, inputsNumber * sizeof(double));
+            from += inputsNumber;
+        }
+        std::memcpy(biases, from, neuronsNumber * sizeof(double));
     }
 
 
@@ -141,7 +249,7 @@ public:
     }
 
 
-    void printWeights() const{
+    virtual void printWeights() const{
         for (unsigned int neuron = 0; neuron < neuronsNumber; neuron++) {
             for (int weight = 0; weight < inputsNumber; weight++) {
                 std::cout << weights[neuron][weight] << " ";
@@ -159,7 +267,7 @@ public:
     }
 
 
-    void printWeightsGradients() const {
+    virtual void printWeightsGradients() const {
         for (unsigned int neuron = 0; neuron < neuronsNumber; neuron++) {
             for (unsigned int weight = 0; weight < inputsNumber; weight++) {
                 std::cout << weightsGradients[neuron][weight] << " ";
@@ -183,5 +291,175 @@ public:
         }
         std::cout << "\n";
     }
+
+
+protected:
+
+    DenseLayer(
+        unsigned int _inputsNumber,
+        unsigned int _neuronsNumber,
+        bool withWeights
+        )
+    : inputsNumber(_inputsNumber),
+      neuronsNumber(_neuronsNumber),
+      ownsBuffers(true),
+      kernel({0, 1, 1}),
+      workers(NULL)
+    {
+        /*
+            layers that store their weights differently (e.g. LowRankLayer)
+            don't allocate the full weights matrix, weights and
+            weightsGradients are NULL then
+        */
+        weights = NULL;
+        weightsGradients = NULL;
+        biases = new double[neuronsNumber];
+
+        outputs = new double[neuronsNumber];
+
+        layerInputs = new double[inputsNumber];
+        biasesGradient = new double[neuronsNumber];
+        inputsGradient = new double[inputsNumber];
+
+        for (unsigned int neuron = 0; neuron < neuronsNumber; neuron++) {
+            biases[neuron] = 0;
+        }
+
+        if (!withWeights) {
+            return;
+        }
+
+        weights = new double*[neuronsNumber];
+        weightsGradients = new double*[neuronsNumber];
+
+        // create 2 dimensional array for weights
+        for (unsigned int neuron = 0; neuron < neuronsNumber; neuron++) {
+            weights[neuron] = new double[inputsNumber];
+            weightsGradients[neuron] = new double[inputsNumber];
+            for (unsigned int input = 0; input < inputsNumber; input++) {
+                weights[neuron][input] = (rand() % 19 + (-9)) * 0.1;
+            }
+        }
+    }
+
+
+private:
+
+    // kernel.threads - 1 threads kept for parallelFor, started at first use
+    WorkerPool* workers;
+
+
+    // -------- KERNELS
+
+    template <typename Function>
+    void parallelFor(unsigned int count, Function function) {
+        // splits [0, count) in kernel.threads contiguous ranges
+        if (kernel.threads <= 1 || count <= 1) {
+            function(0, count);
+            return;
+        }
+
+        // the pool follows kernel.threads (the autotuner changes it)
+        if (workers == NULL || workers->size() != kernel.threads - 1) {
+            delete workers;
+            workers = new WorkerPool(kernel.threads - 1);
+        }
+        workers->run(count, function);
+    }
+
+
+    template <unsigned int Unroll>
+    void forwardNeurons(const double* inputs, unsigned int first, unsigned int last) {
+        /*
+            Unroll neurons are computed together so every input is loaded
+            once per group, blocks of blockSize inputs are kept in cache
+            while all the neurons go through them
+        */
+        const unsigned int blockSize = kernel.blockSize == 0 ? inputsNumber : kernel.blockSize;
+
+        for (unsigned int neuron = first; neuron < last; neuron++) {
+            // adding bias
+            outputs[neuron] = biases[neuron];
+        }
+
+        for (unsigned int block = 0; block < inputsNumber; block += blockSize) {
+            const unsigned int blockEnd = block + blockSize < inputsNumber ? block + blockSize : inputsNumber;
+
+            unsigned int neuron = first;
+            for (; neuron + Unroll <= last; neuron += Unroll) {
+                double sums[Unroll] = {};
+                // multiplying by weights
+                for (unsigned int input = block; input < blockEnd; input++) {
+                    for (unsigned int row = 0; row < Unroll; row++) {
+                        sums[row] += inputs[input] * weights[neuron + row][input];
+                    }
+                }
+                for (unsigned int row = 0; row < Unroll; row++) {
+                    outputs[neuron + row] += sums[row];
+                }
+            }
+            // remaining neurons
+            for (; neuron < last; neuron++) {
+                double sum = 0;
+                for (unsigned int input = block; input < blockEnd; input++) {
+                    sum += inputs[input] * weights[neuron][input];
+                }
+                outputs[neuron] += sum;
+            }
+        }
+    }
+
+
+    template <unsigned int Unroll>
+    void backwardInputs(const double* activationGradient, unsigned int first, unsigned int last) {
+        /*
+            inputsGradient[input] = sum of activationGradient[neuron] * weights[neuron][input]
+            computed one block of inputs at a time, Unroll weights rows per pass
+        */
+        const unsigned int blockSize = kernel.blockSize == 0 ? inputsNumber : kernel.blockSize;
+
+        for (unsigned int input = first; input < last; input++) {
+            inputsGradient[input] = 0;
+        }
+
+        for (unsigned int block = first; block < last; block += blockSize) {
+            const unsigned int blockEnd = block + blockSize < last ? block + blockSize : last;
+
+            unsigned int neuron = 0;
+            for (; neuron + Unroll <= neuronsNumber; neuron += Unroll) {
+                for (unsigned int input = block; input < blockEnd; input++) {
+                    double sum = 0;
+                    for (unsigned int row = 0; row < Unroll; row++) {
+                        sum += activationGradient[neuron + row] * weights[neuron + row][input];
+                    }
+                    inputsGradient[input] += sum;
+                }
+            }
+            // remaining neurons
+            for (; neuron < neuronsNumber; neuron++) {
+                for (unsigned int input = block; input < blockEnd; input++) {
+                    inputsGradient[input] += activationGradient[neuron] * weights[neuron][input];
+                }
+            }
+        }
+    }
     
-};
\ No newline at end of file
+};
+
+
+inline double forwardTime(DenseLayer& layer, unsigned int repetitions) {
+    // seconds taken by repetitions forward passes on a constant input
+    double* inputs = new double[layer.inputsNumber];
+    for (unsigned int input = 0; input < layer.inputsNumber; input++) {
+        inputs[input] = (input % 7) * 0.1;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (unsigned int repetition = 0; repetition < repetitions; repetition++) {
+        layer.forward(inputs);
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    delete[] inputs;
+    return elapsed;
+}
@@ -0,0 +1,222 @@
+#pragma once
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+
+struct ServerStats {
+    /*
+        latencies are measured from submit to result, in microseconds,
+        percentiles are over the last latencyWindow requests
+    */
+    unsigned long requests;
+    unsigned long batches;
+    double p50;
+    double p99;
+    double throughput;      // requests per second since the server started
+
+    void print(std::ostream& stream) const {
+        stream << "requests: " << requests
+               << " batches: " << batches
+               << " p50: " << p50 << "us"
+               << " p99: " << p99 << "us"
+               << " throughput: " << throughput << "/s" << std::endl;
+    }
+};
+
+
+template <typename NetworkType>
+class InferenceServer {
+    /*
+        coalesces concurrent inference requests into micro-batches
+        a batch is run as soon as it has maxBatch requests or its
+        oldest request has waited maxDelay microseconds
+        results are returned through futures
+        the network is used only by the server's worker thread
+    */
+private:
+
+    typedef std::chrono::steady_clock Clock;
+
+    struct Request {
+        std::vector<double> inputs;
+        std::promise<std::vector<double>> result;
+        Clock::time_point submitted;
+    };
+
+    NetworkType& network;
+    unsigned int maxBatch;
+    std::chrono::microseconds maxDelay;
+
+    std::deque<Request> queue;
+    bool stopping;
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::thread worker;
+
+    // statistics, protected by statsMutex
+    // latencies of the last latencyWindow requests, in a ring buffer
+    static const unsigned int latencyWindow = 8192;
+    std::mutex statsMutex;
+    std::vector<double> latencies;
+    unsigned long requests;
+    unsigned long batches;
+    Clock::time_point started;
+
+
+public:
+
+    // --------- CONSTRUCTOR / DESTRUCTOR
+
+    InferenceServer(
+        NetworkType& _network,
+        unsigned int _maxBatch,
+        unsigned int _maxDelayMicroseconds
+        )
+    : network(_network),
+      maxBatch(_maxBatch > 0 ? _maxBatch : 1),
+      maxDelay(_maxDelayMicroseconds),
+      stopping(false),
+      requests(0),
+      batches(0)
+    {
+        latencies.reserve(latencyWindow);
+        started = Clock::now();
+        worker = std::thread(&InferenceServer::serve, this);
+    }
+
+
+    ~InferenceServer() {
+        // requests already submitted are still answered
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_all();
+        worker.join();
+    }
+
+
+    // -------- FUNCTIONS
+
+    std::future<std::vector<double>> submit(const double* values) {
+        // values must hold the network's inputsNumber values
+        Request request;
+        request.inputs.assign(values, values + network.getInputsNumber());
+        request.submitted = Clock::now();
+        std::future<std::vector<double>> result = request.result.get_future();
+
+        bool wake;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(std::move(request));
+            // the worker only needs waking up for a new batch or a full one
+            wake = queue.size() == 1 || queue.size() >= maxBatch;
+        }
+        if (wake) {
+            condition.notify_all();
+        }
+        return result;
+    }
+
+
+    ServerStats getStats() {
+        std::lock_guard<std::mutex> lock(statsMutex);
+
+        ServerStats stats;
+        stats.requests = requests;
+        stats.batches = batches;
+        stats.p50 = percentile(0.5);
+        stats.p99 = percentile(0.99);
+        double elapsed = std::chrono::duration<double>(Clock::now() - started).count();
+        stats.throughput = elapsed > 0 ? requests / elapsed : 0;
+        return stats;
+    }
+
+
+private:
+
+    void serve() {
+        const unsigned int inputsNumber = network.getInputsNumber();
+        const unsigned int outputsNumber = network.getOutputsNumber();
+        double* inputs = new double[maxBatch * inputsNumber];
+        double* outputs = new double[maxBatch * outputsNumber];
+        std::vector<Request> batch;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            condition.wait(lock, [this] {return !queue.empty() || stopping;});
+            if (queue.empty()) {
+                break;
+            }
+
+            // wait for the batch to fill up, at most until the oldest request's deadline
+            Clock::time_point deadline = queue.front().submitted + maxDelay;
+            condition.wait_until(lock, deadline, [this] {return queue.size() >= maxBatch || stopping;});
+
+            unsigned int size = std::min((unsigned int) queue.size(), maxBatch);
+            for (unsigned int request = 0; request < size; request++) {
+                batch.push_back(std::move(queue.front()));
+                queue.pop_front();
+            }
+            lock.unlock();
+
+            for (unsigned int request = 0; request < size; request++) {
+                std::copy(batch[request].inputs.begin(), batch[request].inputs.end(),
+                          inputs + request * inputsNumber);
+            }
+            network.feedBatch(inputs, size, outputs);
+
+            // recorded before answering, so stats include every answered request
+            record(batch, Clock::now());
+
+            // scatter the results back
+            for (unsigned int request = 0; request < size; request++) {
+                batch[request].result.set_value(std::vector<double>(
+                    outputs + request * outputsNumber, outputs + (request + 1) * outputsNumber));
+            }
+            batch.clear();
+
+            lock.lock();
+        }
+
+        delete[] inputs;
+        delete[] outputs;
+    }
+
+
+    void record(const std::vector<Request>& batch, Clock::time_point done) {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        for (const Request& request : batch) {
+            double latency = std::chrono::duration<double, std::micro>(done - request.submitted).count();
+            if (latencies.size() < latencyWindow) {
+                latencies.push_back(latency);
+            }
+            else {
+                latencies[requests % latencyWindow] = latency;
+            }
+            requests++;
+        }
+        batches++;
+    }
+
+
+    double percentile(double fraction) {
+        // statsMutex must be held
+        if (latencies.empty()) {
+            return 0;
+        }
+        std::vector<double> sorted(latencies);
+        unsigned int index = (unsigned int) (fraction * (sorted.size() - 1));
+        std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+        return sorted[index];
+    }
+
+};
@@ -0,0 +1,436 @@
+#pragma once
+#include <iostream>
+#include <cstring>
+#include <cmath>
+#include "DenseLayer.cpp"
+
+
+struct FactorizationReport {
+    /*
+        cost and accuracy of replacing a dense layer with a LowRankLayer
+        relativeError is the Frobenius error of the weights approximation
+        (1 for layers learned from scratch)
+        accuracies are measured on the validation samples given to
+        Network::factorizeLayer (-1 if none were given)
+    */
+    bool replaced;          // false if the layer couldn't be factorized
+    unsigned int rank;
+    unsigned long denseMultiplications;
+    unsigned long factorizedMultiplications;
+    double measuredSpeedup;
+    double relativeError;
+    double accuracyBefore;
+    double accuracyAfter;
+
+    void print() const {
+        if (!replaced) {
+            std::cout << "layer not replaced: it has no dense weights to factorize"
+                      << " or no rank makes it cheaper" << std::endl;
+            return;
+        }
+        std::cout << "rank: " << rank
+                  << " multiplications: " << denseMultiplications << " -> " << factorizedMultiplications
+                  << " speedup: " << measuredSpeedup
+                  << " relative error: " << relativeError;
+        if (accuracyBefore >= 0) {
+            std::cout << " accuracy: " << accuracyBefore << " -> " << accuracyAfter
+                      << " (" << accuracyAfter - accuracyBefore << ")";
+        }
+        std::cout << std::endl;
+    }
+};
+
+
+class LowRankLayer : public DenseLayer {
+    /*
+        dense layer whose weights matrix (neurons x inputs) is
+        factorized as left (neurons x rank) * right (rank x inputs)
+        forward costs rank * (inputs + neurons) multiplications
+        instead of inputs * neurons
+    */
+public:
+
+    unsigned int rank;
+
+    double** left;
+    double** right;
+
+    double** leftGradients;
+    double** rightGradients;
+
+    // right * inputs, needed by backward
+    double* projected;
+    double* projectedGradient;
+
+
+    // --------- CONSTRUCTOR / DESTRUCTOR
+
+    LowRankLayer(
+        unsigned int _inputsNumber,
+        unsigned int _neuronsNumber,
+        unsigned int _rank
+        )
+    : DenseLayer(_inputsNumber, _neuronsNumber, false),
+      rank(_rank)
+    {
+        // random factors, to learn the layer from scratch
+        allocateFactors();
+
+        for (unsigned int neuron = 0; neuron < neuronsNumber; neuron++) {
+            for (unsigned int component = 0; component < rank; component++) {
+                left[neuron][component] = (rand() % 19 + (-9)) * 0.1;
+            }
+        }
+        for (unsigned int component = 0; component < rank; component++) {
+            for (unsigned int input = 0; input < inputsNumber; input++) {
+                right[component][input] = (rand() % 19 + (-9)) * 0.1;
+            }
+        }
+    }
+
+
+    LowRankLayer(const DenseLayer& dense, unsigned int _rank)
+    : DenseLayer(dense.inputsNumber, dense.neuronsNumber, false),
+      rank(_rank)
+    {
+        /*
+            approximates a trained dense layer with its truncated
+            singular value decomposition: weights ~= U * S * V^T
+            left = U * S and right = V^T, biases are copied
+            a layer without dense weights (see isDense) gives zero factors
+        */
+        allocateFactors();
+        std::memcpy(biases, dense.biases, neuronsNumber * sizeof(double));
+        if (dense.isDense()) {
+            truncatedSvd(dense.weights);
+        }
+        else {
+            for (unsigned int neuron = 0; neuron < neuronsNumber; neuron++) {
+                std::memset(left[neuron], 0, rank * sizeof(double));
+            }
+            for (unsigned int component = 0; component < rank; component++) {
+                std::memset(right[component], 0, inputsNumber * sizeof(double));
+            }
+        }
+    }
+
+
+    ~LowRankLayer() {
+        for (unsigned int neuron = 0; neuron < neuronsNumber; neuron++) {
+            delete[] left[neuron];
+            delete[] leftGradients[neuron];
+        }
+        for (unsigned int component = 0; component < rank; component++) {
+            delete[] right[component];
+            delete[] rightGradients[component];
+        }
+        delete[] left;
+        delete[] leftGradients;
+        delete[] right;
+        delete[] rightGradients;
+        delete[] projected;
+        delete[] projectedGradient;
+    }
+
+
+    // -------- FUNCTIONS
+
+    void forward(const double* inputs) override {
+        // copying inputs for backpropagation
+        if (layerInputs != NULL && layerInputs != inputs) {
+            for (unsigned int input = 0; input < inputsNumber; input++) {
+                layerInputs[input] = inputs[input];
+            }
+        }
+
+        // projecting the inputs on the rank components
+        for (unsigned int component = 0; component < rank; component++) {
+            double sum = 0;
+            for (unsigned int input = 0; input < inputsNumber; input++) {
+                sum += right[component][input] * inputs[input];
+            }
+            projected[component] = sum;
+        }
+
+        // expanding the components to the neurons and adding bias
+        for (unsigned int neuron = 0; neuron < neuronsNumber; neuron++) {
+            double sum = biases[neuron];
+            for (unsigned int component = 0; component < rank; component++) {
+                sum += left[neuron][component] * projected[component];
+            }
+            outputs[neuron] = sum;
+        }
+    }
+
+
+    void forwardBatch(const double* inputs, unsigned int batchSize, double* batchOutputs) override {
+        for (unsigned int sample = 0; sample < batchSize; sample++) {
+            forward(inputs + sample * inputsNumber);
+            std::memcpy(batchOutputs + sample * neuronsNumber, outputs, neuronsNumber * sizeof(double));
+        }
+    }
+
+
+    void backward(const double* activationGradient) override {
+        /*
+            same chain rule as DenseLayer, applied to the two factors:
+            output = left * projected + bias, projected = right * inputs
+        */
+        for (unsigned int component = 0; component < rank; component++) {
+            projectedGradient[component] = 0;
+        }
+
+        for (unsigned int neuron = 0; neuron < neuronsNumber; neuron++) {
+            for (unsigned int component = 0; component < rank; component++) {
+                leftGradients[neuron][component] = projected[component] * activationGradient[neuron];
+                projectedGradient[component] += activationGradient[neuron] * left[neuron][component];
+            }
+            biasesGradient[neuron] = activationGradient[neuron];
+        }
+
+        for (unsigned int input = 0; input < inputsNumber; input++) {
+            inputsGradient[input] = 0;
+        }
+
+        for (unsigned int component = 0; component < rank; component++) {
+            for (unsigned int input = 0; input < inputsNumber; input++) {
+                rightGradients[component][input] = layerInputs[input] * projectedGradient[component];
+                inputsGradient[input] += projectedGradient[component] * right[component][input];
+            }
+        }
+    }
+
+
+    void applyGradients(double learningRate) override {
+        // same update applied to both factors
+        for (unsigned int neuron = 0; neuron < neuronsNumber; neuron++) {
+            for (unsigned int component = 0; component < rank; component++) {
+                left[neuron][component] -= learningRate * leftGradients[neuron][component];
+            }
+        }
+        for (unsigned int component = 0; component < rank; component++) {
+            for (unsigned int input = 0; input < inputsNumber; input++) {
+                right[component][input] -= learningRate * rightGradients[component][input];
+            }
+        }
+        for (unsigned int bias = 0; bias < neuronsNumber; bias++) {
+            biases[bias] -= learningRate * biasesGradient[bias];
+        }
+    }
+
+
+    unsigned int parametersNumber() const override {
+        return neuronsNumber * rank + rank * inputsNumber + neuronsNumber;
+    }
+
+
+    void saveParameters(double* to) const override {
+        // left (row by row), right (row by row) and biases
+        for (unsigned int neuron = 0; neuron < neuronsNumber; neuron++) {
+            std::memcpy(to, left[neuron], rank * sizeof(double));
+            to += rank;
+        }
+        for (unsigned int component = 0; component < rank; component++) {
+            std::memcpy(to, right[component], inputsNumber * sizeof(double));
+            to += inputsNumber;
+        }
+        std::memcpy(to, biases, neuronsNumber * sizeof(double));
+    }
+
+
+    void loadParameters(const double* from) override {
+        for (unsigned int neuron = 0; neuron < neuronsNumber; neuron++) {
+            std::memcpy(left[neuron], from, rank * sizeof(double));
+            from += rank;
+        }
+        for (unsigned int component = 0; component < rank; component++) {
+            std::memcpy(right[component], from, inputsNumber * sizeof(double));
+            from += inputsNumber;
+        }
+        std::memcpy(biases, from, neuronsNumber * sizeof(double));
+    }
+
+
+    double relativeError(const DenseLayer& dense) const {
+        /*
+            ||weights - left * right|| / ||weights|| (Frobenius norms)
+            how much of the dense layer's weights is lost by the factorization
+        */
+        if (!dense.isDense()) {
+            return 1;
+        }
+        double error = 0;
+        double norm = 0;
+        for (unsigned int neuron = 0; neuron < neuronsNumber; neuron++) {
+            for (unsigned int input = 0; input < inputsNumber; input++) {
+                double approximation = 0;
+                for (unsigned int component = 0; component < rank; component++) {
+                    approximation += left[neuron][component] * right[component][input];
+                }
+                double difference = dense.weights[neuron][input] - approximation;
+                error += difference * difference;
+                norm += dense.weights[neuron][input] * dense.weights[neuron][input];
+            }
+        }
+        return norm > 0 ? sqrt(error / norm) : 0;
+    }
+
+
+    // -------- PRINTING / DEBUGGING
+
+    void printWeights() const override {
+        // the factors, the full weights matrix is never built
+        printFactors();
+    }
+
+
+    void printWeightsGradients() const override {
+        for (unsigned int neuron = 0; neuron < neuronsNumber; neuron++) {
+            for (unsigned int component = 0; component < rank; component++) {
+                std::cout << leftGradients[neuron][component] << " ";
+            }
+            std::cout << "\n";
+        }
+        std::cout << "\n";
+        for (unsigned int component = 0; component < rank; component++) {
+            for (unsigned int input = 0; input < inputsNumber; input++) {
+                std::cout << rightGradients[component][input] << " ";
+            }
+            std::cout << "\n";
+        }
+    }
+
+
+    void printFactors() const {
+        for (unsigned int neuron = 0; neuron < neuronsNumber; neuron++) {
+            for (unsigned int component = 0; component < rank; component++) {
+                std::cout << left[neuron][component] << " ";
+            }
+            std::cout << "\n";
+        }
+        std::cout << "\n";
+        for (unsigned int component = 0; component < rank; component++) {
+            for (unsigned int input = 0; input < inputsNumber; input++) {
+                std::cout << right[component][input] << " ";
+            }
+            std::cout << "\n";
+        }
+    }
+
+
+private:
+
+    void allocateFactors() {
+        left = new double*[neuronsNumber];
+        leftGradients = new double*[neuronsNumber];
+        for (unsigned int neuron = 0; neuron < neuronsNumber; neuron++) {
+            left[neuron] = new double[rank];
+            leftGradients[neuron] = new double[rank];
+        }
+
+        right = new double*[rank];
+        rightGradients = new double*[rank];
+        for (unsigned int component = 0; component < rank; component++) {
+            right[component] = new double[inputsNumber];
+            rightGradients[component] = new double[inputsNumber];
+        }
+
+        projected = new double[rank];
+        projectedGradient = new double[rank];
+    }
+
+
+    void truncatedSvd(double** weights) {
+        /*
+            power iteration on weights^T * weights: every right singular
+            vector v is found by repeatedly applying weights^T * weights
+            and removing the components along the vectors already found
+            the left factor column is weights * v (= u * sigma)
+        */
+        double* vector = new double[inputsNumber];
+        double* product = new double[neuronsNumber];
+
+        for (unsigned int component = 0; component < rank; component++) {
+            for (unsigned int input = 0; input < inputsNumber; input++) {
+                // deterministic start, not orthogonal to any vector in general
+                vector[input] = 1.0 / (input + component + 1);
+            }
+
+            for (unsigned int iteration = 0; iteration < 200; iteration++) {
+                orthogonalize(vector, component);
+
+                // product = weights * vector
+                for (unsigned int neuron = 0; neuron < neuronsNumber; neuron++) {
+                    product[neuron] = 0;
+                    for (unsigned int input = 0; input < inputsNumber; input++) {
+                        product[neuron] += weights[neuron][input] * vector[input];
+                    }
+                }
+                // vector = weights^T * product
+                for (unsigned int input = 0; input < inputsNumber; input++) {
+                    vector[input] = 0;
+                }
+                for (unsigned int neuron = 0; neuron < neuronsNumber; neuron++) {
+                    for (unsigned int input = 0; input < inputsNumber; input++) {
+                        vector[input] += weights[neuron][input] * product[neuron];
+                    }
+                }
+
+                orthogonalize(vector, component);
+                if (!normalize(vector)) {
+                    // the matrix has rank < component, the rest is 0
+                    break;
+                }
+            }
+
+            for (unsigned int input = 0; input < inputsNumber; input++) {
+                right[component][input] = vector[input];
+            }
+            for (unsigned int neuron = 0; neuron < neuronsNumber; neuron++) {
+                double sum = 0;
+                for (unsigned int input = 0; input < inputsNumber; input++) {
+                    sum += weights[neuron][input] * vector[input];
+                }
+                left[neuron][component] = sum;
+            }
+        }
+
+        delete[] vector;
+        delete[] product;
+    }
+
+
+    void orthogonalize(double* vector, unsigned int components) const {
+        // removes the projections on the first components right vectors
+        for (unsigned int component = 0; component < components; component++) {
+            double dot = 0;
+            for (unsigned int input = 0; input < inputsNumber; input++) {
+                dot += vector[input] * right[component][input];
+            }
+            for (unsigned int input = 0; input < inputsNumber; input++) {
+                vector[input] -= dot * right[component][input];
+            }
+        }
+    }
+
+
+    bool normalize(double* vector) const {
+        double norm = 0;
+        for (unsigned int input = 0; input < inputsNumber; input++) {
+            norm += vector[input] * vector[input];
+        }
+        norm = sqrt(norm);
+        if (norm < 1e-12) {
+            for (unsigned int input = 0; input < inputsNumber; input++) {
+                vector[input] = 0;
+            }
+            return false;
+        }
+        for (unsigned int input = 0; input < inputsNumber; input++) {
+            vector[input] /= norm;
+        }
+        return true;
+    }
+
+};
+
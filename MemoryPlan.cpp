@@ -0,0 +1,111 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+
+
+class MemoryPlan {
+    /*
+        packs the intermediate tensors of a layer sequence (or graph)
+        into one shared slab
+        every tensor is described by its size and by the first and
+        last step (forward or backward operation) that use it,
+        tensors whose lifetimes don't overlap can share the same memory
+    */
+private:
+
+    struct Tensor {
+        unsigned int size;
+        unsigned int first;
+        unsigned int last;
+        unsigned int offset;
+    };
+
+    std::vector<Tensor> tensors;
+    unsigned int slabSize;
+
+
+public:
+
+    // --------- CONSTRUCTOR / DESTRUCTOR
+
+    MemoryPlan()
+    : slabSize(0) {}
+
+
+    // -------- FUNCTIONS
+
+    unsigned int addTensor(unsigned int size, unsigned int first, unsigned int last) {
+        // returns the tensor's id, lifetime is [first, last] (inclusive)
+        tensors.push_back({size, first, last, 0});
+        return tensors.size() - 1;
+    }
+
+
+    void plan() {
+        /*
+            greedy offset assignment: tensors are placed from the biggest
+            to the smallest, each one at the lowest offset that doesn't
+            overlap a placed tensor alive at the same time
+        */
+        std::vector<unsigned int> order(tensors.size());
+        for (unsigned int tensor = 0; tensor < tensors.size(); tensor++) {
+            order[tensor] = tensor;
+        }
+        std::stable_sort(order.begin(), order.end(), [this](unsigned int a, unsigned int b) {
+            return tensors[a].size > tensors[b].size;
+        });
+
+        slabSize = 0;
+        std::vector<unsigned int> placed;
+
+        for (unsigned int id : order) {
+            Tensor& tensor = tensors[id];
+
+            // placed tensors alive at the same time, sorted by offset
+            std::vector<unsigned int> alive;
+            for (unsigned int other : placed) {
+                if (tensors[other].first <= tensor.last && tensor.first <= tensors[other].last) {
+                    alive.push_back(other);
+                }
+            }
+            std::sort(alive.begin(), alive.end(), [this](unsigned int a, unsigned int b) {
+                return tensors[a].offset < tensors[b].offset;
+            });
+
+            // first gap big enough
+            unsigned int offset = 0;
+            for (unsigned int other : alive) {
+                if (offset + tensor.size <= tensors[other].offset) {
+                    break;
+                }
+                offset = std::max(offset, tensors[other].offset + tensors[other].size);
+            }
+
+            tensor.offset = offset;
+            slabSize = std::max(slabSize, offset + tensor.size);
+            placed.push_back(id);
+        }
+    }
+
+
+    unsigned int getSlabSize() const {
+        // number of doubles needed by the slab, valid after plan()
+        return slabSize;
+    }
+
+
+    unsigned int getTensorsSize() const {
+        // number of doubles needed without sharing memory
+        unsigned int size = 0;
+        for (const Tensor& tensor : tensors) {
+            size += tensor.size;
+        }
+        return size;
+    }
+
+
+    double* bind(double* slab, unsigned int tensor) const {
+        return slab + tensors[tensor].offset;
+    }
+
+};
@@ -0,0 +1,374 @@
+#pragma once
+#include <iostream>
+#include <random>
+#include <cmath>
+
+
+template <unsigned int Models>
+class ModelBatch {
+    /*
+        trains Models independent networks of the same topology
+        at once (Dense -> Relu -> ... -> Dense -> SoftMax, with
+        cross-entropy loss and SGD, like Network)
+        every value is stored in structure-of-arrays layout:
+        the values of the different models are interleaved so that
+        value [x][model] lives at x * Models + model and the
+        innermost loops run over the models, one per SIMD lane
+    */
+private:
+
+    unsigned int layersNumber;
+    unsigned int outputsNumber;
+    unsigned int inputsNumber;
+    unsigned int neuronPerLayer;
+
+    // sizes of each layer
+    unsigned int* layerInputs;
+    unsigned int* layerNeurons;
+
+    // weights[layer][(neuron * inputs + input) * Models + model]
+    double** weights;
+    // biases[layer][neuron * Models + model]
+    double** biases;
+
+    // activations[0] is the network input, activations[layer+1] the
+    // output of the activation function following layer
+    double** activations;
+    // weighted sums (dense outputs) of each layer
+    double** sums;
+
+    // gradients with respect to the weighted sums and to the inputs
+    double* sumsGradient;
+    double* inputsGradient;
+
+    double learningRates[Models];
+    double loss[Models];
+    unsigned int hotOnes[Models];
+
+
+public:
+
+    // --------- CONSTRUCTOR / DESTRUCTOR
+
+    ModelBatch(
+        unsigned int _inputsNumber,
+        unsigned int _layersNumber,
+        unsigned int _outputsNumber,
+        unsigned int _neuronPerLayer,
+        const double* _learningRates,
+        const unsigned int* seeds
+        )
+    : layersNumber(_layersNumber),
+      outputsNumber(_outputsNumber),
+      inputsNumber(_inputsNumber),
+      neuronPerLayer(_neuronPerLayer)
+    {
+        layerInputs = new unsigned int[layersNumber];
+        layerNeurons = new unsigned int[layersNumber];
+
+        for (unsigned int layer = 0; layer < layersNumber; layer++) {
+            layerInputs[layer] = layer == 0 ? inputsNumber : neuronPerLayer;
+            layerNeurons[layer] = layer == layersNumber - 1 ? outputsNumber : neuronPerLayer;
+        }
+
+        weights = new double*[layersNumber];
+        biases = new double*[layersNumber];
+        sums = new double*[layersNumber];
+        activations = new double*[layersNumber + 1];
+
+        activations[0] = new double[inputsNumber * Models];
+
+        unsigned int widest = inputsNumber > neuronPerLayer ? inputsNumber : neuronPerLayer;
+        if (outputsNumber > widest) {
+            widest = outputsNumber;
+        }
+        sumsGradient = new double[widest * Models];
+        inputsGradient = new double[widest * Models];
+
+        for (unsigned int layer = 0; layer < layersNumber; layer++) {
+            weights[layer] = new double[layerNeurons[layer] * layerInputs[layer] * Models];
+            biases[layer] = new double[layerNeurons[layer] * Models];
+            sums[layer] = new double[layerNeurons[layer] * Models];
+            activations[layer+1] = new double[layerNeurons[layer] * Models];
+
+            for (unsigned int bias = 0; bias < layerNeurons[layer] * Models; bias++) {
+                biases[layer][bias] = 0;
+            }
+        }
+
+        /*
+            every model gets its own random generator so that
+            a model's initial weights depend only on its seed,
+            the same distribution of DenseLayer is used
+        */
+        for (unsigned int model = 0; model < Models; model++) {
+            learningRates[model] = _learningRates[model];
+            loss[model] = 0;
+            hotOnes[model] = 0;
+
+            std::mt19937 generator(seeds[model]);
+            for (unsigned int layer = 0; layer < layersNumber; layer++) {
+                unsigned int weightsNumber = layerNeurons[layer] * layerInputs[layer];
+                for (unsigned int weight = 0; weight < weightsNumber; weight++) {
+                    weights[layer][weight * Models + model] = ((int) (generator() % 19) - 9) * 0.1;
+                }
+            }
+        }
+    }
+
+
+    ~ModelBatch() {
+        for (unsigned int layer = 0; layer < layersNumber; layer++) {
+            delete[] weights[layer];
+            delete[] biases[layer];
+            delete[] sums[layer];
+            delete[] activations[layer+1];
+        }
+        delete[] activations[0];
+
+        delete[] weights;
+        delete[] biases;
+        delete[] sums;
+        delete[] activations;
+        delete[] sumsGradient;
+        delete[] inputsGradient;
+        delete[] layerInputs;
+        delete[] layerNeurons;
+    }
+
+
+    // -------- FUNCTIONS
+
+    void forward() {
+        /*
+            forward pass of every model on the interleaved
+            input already stored in activations[0]
+        */
+        for (unsigned int layer = 0; layer < layersNumber; layer++) {
+            const unsigned int inputs = layerInputs[layer];
+            const double* input = activations[layer];
+            const double* layerWeights = weights[layer];
+            double* sum = sums[layer];
+
+            for (unsigned int neuron = 0; neuron < layerNeurons[layer]; neuron++) {
+                double* neuronSum = sum + neuron * Models;
+                const double* neuronWeights = layerWeights + neuron * inputs * Models;
+
+                for (unsigned int model = 0; model < Models; model++) {
+                    neuronSum[model] = biases[layer][neuron * Models + model];
+                }
+                for (unsigned int in = 0; in < inputs; in++) {
+                    for (unsigned int model = 0; model < Models; model++) {
+                        neuronSum[model] += input[in * Models + model] * neuronWeights[in * Models + model];
+                    }
+                }
+            }
+
+            double* output = activations[layer+1];
+            if (layer < layersNumber - 1) {
+                // relu
+                for (unsigned int value = 0; value < layerNeurons[layer] * Models; value++) {
+                    output[value] = sum[value] * (sum[value] > 0);
+                }
+            }
+            else {
+                softMax(sum, output);
+            }
+        }
+    }
+
+
+    void backwardAndOptimize() {
+        /*
+            backpropagates the cross-entropy loss of every model
+            against its own hotOne label (stored by feed) and applies
+            SGD with every model's own learning rate
+        */
+        const double* output = activations[layersNumber];
+
+        // softmax + cross-entropy gradient
+        for (unsigned int neuron = 0; neuron < outputsNumber; neuron++) {
+            for (unsigned int model = 0; model < Models; model++) {
+                sumsGradient[neuron * Models + model] = output[neuron * Models + model] - (hotOnes[model] == neuron);
+            }
+        }
+
+        for (unsigned int layer = layersNumber - 1; ; layer--) {
+            const unsigned int inputs = layerInputs[layer];
+            const double* input = activations[layer];
+            double* layerWeights = weights[layer];
+
+            for (unsigned int value = 0; value < inputs * Models; value++) {
+                inputsGradient[value] = 0;
+            }
+
+            for (unsigned int neuron = 0; neuron < layerNeurons[layer]; neuron++) {
+                const double* gradient = sumsGradient + neuron * Models;
+                double* neuronWeights = layerWeights + neuron * inputs * Models;
+
+                for (unsigned int in = 0; in < inputs; in++) {
+                    for (unsigned int model = 0; model < Models; model++) {
+                        /*
+                            the input's gradient is calculated with the
+                            weight before it's updated, like Network does
+                        */
+                        double* weight = neuronWeights + in * Models + model;
+                        inputsGradient[in * Models + model] += gradient[model] * *weight;
+                        *weight -= learningRates[model] * gradient[model] * input[in * Models + model];
+                    }
+                }
+                for (unsigned int model = 0; model < Models; model++) {
+                    biases[layer][neuron * Models + model] -= learningRates[model] * gradient[model];
+                }
+            }
+
+            if (layer == 0) {
+                break;
+            }
+
+            // relu gradient of the previous layer
+            const double* previousSum = sums[layer-1];
+            for (unsigned int value = 0; value < inputs * Models; value++) {
+                sumsGradient[value] = inputsGradient[value] * (previousSum[value] > 0);
+            }
+        }
+    }
+
+
+    void feed(const double* values, const unsigned int hotOne) {
+        /*
+            feeds the same sample to every model
+            e.g. for hyperparameter sweeps and ensembles
+        */
+        for (unsigned int input = 0; input < inputsNumber; input++) {
+            for (unsigned int model = 0; model < Models; model++) {
+                activations[0][input * Models + model] = values[input];
+            }
+        }
+        for (unsigned int model = 0; model < Models; model++) {
+            hotOnes[model] = hotOne;
+        }
+        forward();
+        computeLoss();
+    }
+
+
+    void feedInterleaved(const double* values, const unsigned int* _hotOnes) {
+        /*
+            feeds a different sample to every model
+            values must be interleaved: values[input * Models + model]
+        */
+        for (unsigned int value = 0; value < inputsNumber * Models; value++) {
+            activations[0][value] = values[value];
+        }
+        for (unsigned int model = 0; model < Models; model++) {
+            hotOnes[model] = _hotOnes[model];
+        }
+        forward();
+        computeLoss();
+    }
+
+
+    double getOutput(unsigned int model, unsigned int output) const {
+        return activations[layersNumber][output * Models + model];
+    }
+
+
+    double getLoss(unsigned int model) const {
+        return loss[model];
+    }
+
+
+    double getLearningRate(unsigned int model) const {
+        return learningRates[model];
+    }
+
+
+    unsigned int getModelStateSize() const {
+        // doubles written by saveModelState, same as Network::getStateSize
+        unsigned int size = 1;
+        for (unsigned int layer = 0; layer < layersNumber; layer++) {
+            size += layerNeurons[layer] * layerInputs[layer] + layerNeurons[layer];
+        }
+        return size;
+    }
+
+
+    void saveModelState(unsigned int model, double* to) const {
+        /*
+            copies one model's state in the layout of Network::saveState
+            (weights row by row and biases of every layer, then the SGD
+            learning rate), so it can be loaded in a Network with
+            loadState or written like a checkpoint
+        */
+        for (unsigned int layer = 0; layer < layersNumber; layer++) {
+            unsigned int weightsNumber = layerNeurons[layer] * layerInputs[layer];
+            for (unsigned int weight = 0; weight < weightsNumber; weight++) {
+                *to++ = weights[layer][weight * Models + model];
+            }
+            for (unsigned int neuron = 0; neuron < layerNeurons[layer]; neuron++) {
+                *to++ = biases[layer][neuron * Models + model];
+            }
+        }
+        *to = learningRates[model];
+    }
+
+
+    // -------- PRINTING / DEBUGGING
+
+    void printLoss() const {
+        for (unsigned int model = 0; model < Models; model++) {
+            std::cout << loss[model] << " ";
+        }
+        std::cout << std::endl;
+    }
+
+
+    void printNetworkOutput(unsigned int model) const {
+        for (unsigned int output = 0; output < outputsNumber; output++) {
+            std::cout << getOutput(model, output) << " ";
+        }
+        std::cout << "\n";
+    }
+
+
+private:
+
+    void softMax(const double* smInputs, double* outputs) const {
+        // same as Activations::SoftMax, one lane per model
+        double biggestValue[Models];
+        double expSum[Models];
+
+        for (unsigned int model = 0; model < Models; model++) {
+            biggestValue[model] = smInputs[model];
+            expSum[model] = 0;
+        }
+        for (unsigned int input = 1; input < outputsNumber; input++) {
+            for (unsigned int model = 0; model < Models; model++) {
+                if (smInputs[input * Models + model] > biggestValue[model]) {
+                    biggestValue[model] = smInputs[input * Models + model];
+                }
+            }
+        }
+        for (unsigned int value = 0; value < outputsNumber; value++) {
+            for (unsigned int model = 0; model < Models; model++) {
+                outputs[value * Models + model] = exp(smInputs[value * Models + model] - biggestValue[model]);
+                expSum[model] += outputs[value * Models + model];
+            }
+        }
+        for (unsigned int value = 0; value < outputsNumber; value++) {
+            for (unsigned int model = 0; model < Models; model++) {
+                outputs[value * Models + model] /= expSum[model];
+            }
+        }
+    }
+
+
+    void computeLoss() {
+        // cross-entropy of every model
+        for (unsigned int model = 0; model < Models; model++) {
+            loss[model] = -(log(getOutput(model, hotOnes[model])));
+        }
+    }
+
+};
@@ -2,10 +2,15 @@
 #include <iostream>
 #include <time.h>
 #include <cmath>
+#include <fstream>
 #include "DenseLayer.cpp"
+#include "LowRankLayer.cpp"
+#include "SparseLayer.cpp"
 #include "Activations.cpp"
 #include "Losses.cpp"
 #include "Optimizers.cpp"
+#include "MemoryPlan.cpp"
+#include "Autotuner.cpp"
 
 
 template <
@@ -32,6 +37,18 @@ private:
 
     OptimizerType* optimizer;
 
+    // shared slab for layers and activations buffers, see planMemory
+    double* memory;
+    unsigned int memorySize;
+
+    // picks layers' kernel configurations at first use, see useAutotuner
+    Autotuner* autotuner;
+    bool tuned;
+
+    // ping-pong buffers of feedBatch
+    double* batchMemory;
+    unsigned int batchCapacity;
+
 
 public:
 
@@ -72,6 +89,14 @@ public:
         // initialize optimizer
         optimizer = new OptimizerType(_learningRate);
 
+        memory = NULL;
+        memorySize = 0;
+
+        autotuner = NULL;
+        tuned = false;
+
+        batchMemory = NULL;
+        batchCapacity = 0;
     }
 
 
@@ -90,11 +115,18 @@ public:
 
         delete lossFunction;
         delete optimizer;
+
+        delete[] memory;
+        delete[] batchMemory;
         
     }
 
 
     void forward(const double* values) {
+        if (autotuner != NULL && !tuned) {
+            autotune();
+        }
+
         // forward pass through input layer
         layers[0]->forward(values);
         innerActivations[0]->forward(layers[0]->outputs);
@@ -122,7 +154,7 @@ public:
        outputActivation->backward(lossFunction->gradient);
        layers[layersNumber-1]->backward(outputActivation->gradient);
 
-       for (unsigned int layer = layersNumber-2; layer > -1; layer--) {
+       for (int layer = layersNumber-2; layer > -1; layer--) {
            innerActivations[layer]->backward(layers[layer+1]->inputsGradient);
            layers[layer]->backward(innerActivations[layer]->gradient);
        }
@@ -136,7 +168,7 @@ public:
         layers[layersNumber-1]->backward(outputActivation->gradient);
         optimizer->optimize(layers[layersNumber-1]);
 
-        for (unsigned int layer = layersNumber-2; layer > -1; layer--) {
+        for (int layer = layersNumber-2; layer > -1; layer--) {
             innerActivations[layer]->backward(layers[layer+1]->inputsGradient);
             layers[layer]->backward(innerActivations[layer]->gradient);
             optimizer->optimize(layers[layer]);
@@ -155,6 +187,263 @@ public:
     }
 
 
+    void planMemory(bool training = true) {
+        /*
+            replaces the private buffers of layers and activation functions
+            with a single slab where buffers that are never alive at the
+            same time share memory
+            steps are numbered in execution order: the forward pass of
+            layer l is step 2l and of its activation 2l+1, then come the
+            backward passes from the output to the input
+            with training == false only the forward pass is planned:
+            two buffers are alive at a time (plus the network's output)
+            and backward must not be called anymore
+        */
+        MemoryPlan plan;
+        const unsigned int end = 4 * layersNumber + 1;
+
+        unsigned int* sums = new unsigned int[layersNumber];
+        unsigned int* activated = new unsigned int[layersNumber];
+        unsigned int* activationsGradients = new unsigned int[layersNumber];
+        unsigned int* inputsGradients = new unsigned int[layersNumber];
+        unsigned int input = 0;
+
+        if (training) {
+            input = plan.addTensor(inputsNumber, 0, denseBackwardStep(0));
+        }
+
+        for (unsigned int layer = 0; layer < layersNumber; layer++) {
+            unsigned int neurons = layers[layer]->neuronsNumber;
+
+            if (training) {
+                sums[layer] = plan.addTensor(neurons, 2 * layer, activationBackwardStep(layer));
+                activated[layer] = plan.addTensor(neurons, 2 * layer + 1,
+                    layer == layersNumber - 1 ? end : denseBackwardStep(layer + 1));
+                activationsGradients[layer] = plan.addTensor(neurons,
+                    activationBackwardStep(layer), denseBackwardStep(layer));
+                inputsGradients[layer] = plan.addTensor(layers[layer]->inputsNumber, denseBackwardStep(layer),
+                    layer == 0 ? denseBackwardStep(0) : activationBackwardStep(layer - 1));
+            }
+            else {
+                sums[layer] = plan.addTensor(neurons, 2 * layer, 2 * layer + 1);
+                activated[layer] = plan.addTensor(neurons, 2 * layer + 1,
+                    layer == layersNumber - 1 ? end : 2 * layer + 2);
+            }
+        }
+
+        plan.plan();
+        delete[] memory;
+        memorySize = plan.getSlabSize();
+        memory = new double[memorySize];
+
+        for (unsigned int layer = 0; layer < layersNumber; layer++) {
+            double* layerInputs = NULL;
+            if (layer > 0) {
+                layerInputs = plan.bind(memory, activated[layer - 1]);
+            }
+            else if (training) {
+                layerInputs = plan.bind(memory, input);
+            }
+
+            layers[layer]->bindBuffers(
+                plan.bind(memory, sums[layer]),
+                layerInputs,
+                training ? plan.bind(memory, inputsGradients[layer]) : NULL
+            );
+
+            double* activationGradient = training ? plan.bind(memory, activationsGradients[layer]) : NULL;
+            if (layer < layersNumber - 1) {
+                innerActivations[layer]->bindBuffers(
+                    plan.bind(memory, sums[layer]), plan.bind(memory, activated[layer]), activationGradient);
+            }
+            else {
+                outputActivation->bindBuffers(
+                    plan.bind(memory, sums[layer]), plan.bind(memory, activated[layer]), activationGradient);
+            }
+        }
+
+        delete[] sums;
+        delete[] activated;
+        delete[] activationsGradients;
+        delete[] inputsGradients;
+    }
+
+
+    unsigned int getMemorySize() const {
+        // doubles in the shared slab, 0 if planMemory hasn't been called
+        return memorySize;
+    }
+
+
+    void useAutotuner(Autotuner* _autotuner) {
+        /*
+            the layers' kernels will be tuned by _autotuner at the next
+            forward pass, the autotuner is not owned by the network
+        */
+        autotuner = _autotuner;
+        tuned = false;
+    }
+
+
+    void autotune() {
+        /*
+            tunes every layer now, layers with the same shape share the cached result
+            factorized and pruned layers are skipped, their kernels don't use kernel
+        */
+        for (unsigned int layer = 0; layer < layersNumber; layer++) {
+            if (layers[layer]->isDense()) {
+                autotuner->tune(layers[layer]);
+            }
+        }
+        tuned = true;
+    }
+
+
+    FactorizationReport factorizeLayer(
+        unsigned int layer,
+        unsigned int rank,
+        bool fromScratch = false,
+        const double* values = NULL,
+        const unsigned int* hotOnes = NULL,
+        unsigned int samples = 0
+        ) {
+        /*
+            replaces layers[layer] with a LowRankLayer of the given rank,
+            from the truncated SVD of its weights or with random factors
+            (fromScratch) to be learned, the network can be fine-tuned
+            afterwards with backwardAndOptimize
+            the report compares the forward cost of the two layers and,
+            if validation samples are given (values and hotOnes, like
+            feedBatch), the accuracy before and after
+            rank is lowered to the biggest one that is still cheaper than
+            the dense layer (rank * (inputs + neurons) < inputs * neurons)
+            a layer that is already factorized or pruned can only be
+            replaced fromScratch, otherwise (or if no rank is cheaper)
+            it's left as it is and report.replaced is false
+        */
+        DenseLayer* dense = layers[layer];
+        FactorizationReport report;
+
+        unsigned long denseMultiplications = (unsigned long) dense->inputsNumber * dense->neuronsNumber;
+        unsigned long maxRank = denseMultiplications > 0
+            ? (denseMultiplications - 1) / (dense->inputsNumber + dense->neuronsNumber) : 0;
+        if (rank > maxRank) {
+            rank = maxRank;
+        }
+
+        report.replaced = rank > 0 && (fromScratch || dense->isDense());
+        report.accuracyBefore = samples > 0 ? accuracy(values, hotOnes, samples) : -1;
+        report.accuracyAfter = report.accuracyBefore;
+        if (!report.replaced) {
+            report.rank = 0;
+            report.denseMultiplications = 0;
+            report.factorizedMultiplications = 0;
+            report.measuredSpeedup = 1;
+            report.relativeError = 0;
+            return report;
+        }
+
+        LowRankLayer* factorized = fromScratch
+            ? new LowRankLayer(dense->inputsNumber, dense->neuronsNumber, rank)
+            : new LowRankLayer(*dense, rank);
+
+        report.rank = rank;
+        report.denseMultiplications = denseMultiplications;
+        report.factorizedMultiplications = (unsigned long) rank * (dense->inputsNumber + dense->neuronsNumber);
+        report.relativeError = fromScratch ? 1 : factorized->relativeError(*dense);
+        report.measuredSpeedup = replaceLayer(layer, factorized);
+
+        report.accuracyAfter = samples > 0 ? accuracy(values, hotOnes, samples) : -1;
+        return report;
+    }
+
+
+    PruningReport pruneLayer(
+        unsigned int layer,
+        double sparsity,
+        const double* values = NULL,
+        const unsigned int* hotOnes = NULL,
+        unsigned int samples = 0
+        ) {
+        /*
+            replaces layers[layer] with a SparseLayer keeping only its
+            (1 - sparsity) biggest weights in absolute value
+            sparsity is clamped to [0, 1]
+            see pruneLayerBelow for the report
+        */
+        return pruneLayerBelow(layer, SparseLayer::thresholdFor(*layers[layer], sparsity), values, hotOnes, samples);
+    }
+
+
+    PruningReport pruneLayerBelow(
+        unsigned int layer,
+        double threshold,
+        const double* values = NULL,
+        const unsigned int* hotOnes = NULL,
+        unsigned int samples = 0
+        ) {
+        /*
+            replaces layers[layer] with a SparseLayer keeping only the
+            weights at least threshold in absolute value
+            if validation samples are given (values and hotOnes, like
+            feedBatch) the report has the accuracy before and after
+            a layer that is already pruned or factorized is left as it
+            is and report.replaced is false
+        */
+        DenseLayer* dense = layers[layer];
+        PruningReport report;
+        report.replaced = dense->isDense();
+        report.accuracyBefore = samples > 0 ? accuracy(values, hotOnes, samples) : -1;
+        report.accuracyAfter = report.accuracyBefore;
+        if (!report.replaced) {
+            report.threshold = 0;
+            report.sparsity = 0;
+            report.nonZeros = 0;
+            report.measuredSpeedup = 1;
+            return report;
+        }
+
+        report.threshold = threshold;
+        SparseLayer* sparse = new SparseLayer(*dense, threshold);
+        report.sparsity = sparse->getSparsity();
+        report.nonZeros = sparse->nonZeros;
+        report.measuredSpeedup = replaceLayer(layer, sparse);
+
+        report.accuracyAfter = samples > 0 ? accuracy(values, hotOnes, samples) : -1;
+        return report;
+    }
+
+
+    double accuracy(const double* values, const unsigned int* hotOnes, unsigned int samples) {
+        /*
+            fraction of samples whose most probable output is hotOne
+            values holds inputsNumber values per sample, like feedBatch
+        */
+        const unsigned int batchSize = 256;
+        double* batchOutputs = new double[batchSize * outputsNumber];
+        unsigned int correct = 0;
+
+        for (unsigned int first = 0; first < samples; first += batchSize) {
+            unsigned int size = samples - first < batchSize ? samples - first : batchSize;
+            feedBatch(values + first * inputsNumber, size, batchOutputs);
+
+            for (unsigned int sample = 0; sample < size; sample++) {
+                const double* sampleOutputs = batchOutputs + sample * outputsNumber;
+                unsigned int best = 0;
+                for (unsigned int output = 1; output < outputsNumber; output++) {
+                    if (sampleOutputs[output] > sampleOutputs[best]) {
+                        best = output;
+                    }
+                }
+                correct += best == hotOnes[first + sample];
+            }
+        }
+
+        delete[] batchOutputs;
+        return (double) correct / samples;
+    }
+
+
     void feed(const double *values) {
         /*
             takes just input values, no labels
@@ -177,6 +466,52 @@ public:
     }
 
 
+    void feedBatch(const double* values, unsigned int batchSize, double* batchOutputs) {
+        /*
+            inference on batchSize samples at once
+            values holds inputsNumber values per sample, one sample after
+            another, batchOutputs receives outputsNumber values per sample
+            the layers' own buffers (and getOutput) are not valid afterwards
+        */
+        if (autotuner != NULL && !tuned) {
+            autotune();
+        }
+
+        unsigned int width = inputsNumber > neuronPerLayer ? inputsNumber : neuronPerLayer;
+        if (outputsNumber > width) {
+            width = outputsNumber;
+        }
+        if (batchCapacity < batchSize * width) {
+            delete[] batchMemory;
+            batchCapacity = batchSize * width;
+            batchMemory = new double[2 * batchCapacity];
+        }
+
+        // dense layers write in sums, activations in activated
+        double* sums = batchMemory;
+        double* activated = batchMemory + batchCapacity;
+
+        const double* inputs = values;
+        for (unsigned int layer = 0; layer < layersNumber - 1; layer++) {
+            layers[layer]->forwardBatch(inputs, batchSize, sums);
+            innerActivations[layer]->forwardBatch(sums, batchSize, activated);
+            inputs = activated;
+        }
+        layers[layersNumber-1]->forwardBatch(inputs, batchSize, sums);
+        outputActivation->forwardBatch(sums, batchSize, batchOutputs);
+    }
+
+
+    unsigned int getInputsNumber() const {
+        return inputsNumber;
+    }
+
+
+    unsigned int getOutputsNumber() const {
+        return outputsNumber;
+    }
+
+
     const double* getOutput() const {
         return outputActivation->outputs;
     }
@@ -187,8 +522,80 @@ public:
     }
 
 
+    unsigned int getStateSize() const {
+        /*
+            number of doubles needed to store the network's state:
+            the parameters of every layer plus the optimizer's state
+        */
+        unsigned int size = optimizer->stateNumber();
+        for (unsigned int layer = 0; layer < layersNumber; layer++) {
+            size += layers[layer]->parametersNumber();
+        }
+        return size;
+    }
+
+
+    void saveState(double* to) const {
+        /*
+            copies the network's state in a flat array of getStateSize() doubles
+            must not be called during a forward or backward pass
+        */
+        for (unsigned int layer = 0; layer < layersNumber; layer++) {
+            layers[layer]->saveParameters(to);
+            to += layers[layer]->parametersNumber();
+        }
+        optimizer->saveState(to);
+    }
+
+
+    void loadState(const double* from) {
+        // inverse of saveState, the network must have the same topology
+        for (unsigned int layer = 0; layer < layersNumber; layer++) {
+            layers[layer]->loadParameters(from);
+            from += layers[layer]->parametersNumber();
+        }
+        optimizer->loadState(from);
+    }
+
+
     void store(const char* fileName) const {
-        // TODO make a store function that stores the network in a file
+        /*
+            stores the network's state in a binary file:
+            the state size (unsigned int) followed by the state
+            same format written by Checkpointer
+        */
+        unsigned int size = getStateSize();
+        double* state = new double[size];
+        saveState(state);
+
+        std::ofstream file(fileName, std::ios::binary);
+        file.write((const char*) &size, sizeof(size));
+        file.write((const char*) state, size * sizeof(double));
+
+        delete[] state;
+    }
+
+
+    bool load(const char* fileName) {
+        /*
+            loads a state stored by store (or by Checkpointer)
+            returns false if the file can't be read or doesn't match
+            the network's topology
+        */
+        std::ifstream file(fileName, std::ios::binary);
+        unsigned int size;
+        if (!file.read((char*) &size, sizeof(size)) || size != getStateSize()) {
+            return false;
+        }
+
+        double* state = new double[size];
+        bool read = (bool) file.read((char*) state, size * sizeof(double));
+        if (read) {
+            loadState(state);
+        }
+
+        delete[] state;
+        return read;
     }
 
 
@@ -272,5 +679,41 @@ public:
     void printLoss() const {
         std::cout << loss << std::endl;
     }
+
+
+private:
+
+    double replaceLayer(unsigned int layer, DenseLayer* replacement) {
+        /*
+            puts replacement in place of layers[layer] (which is deleted)
+            and returns how much faster its forward pass is
+        */
+        DenseLayer* replaced = layers[layer];
+
+        unsigned int repetitions = 1 + 10000000 / (replaced->inputsNumber * replaced->neuronsNumber + 1);
+        double replacementTime = forwardTime(*replacement, repetitions);
+        double speedup = forwardTime(*replaced, repetitions) / replacementTime;
+
+        // keep the buffers assigned by planMemory
+        if (!replaced->ownsBuffers) {
+            replacement->bindBuffers(replaced->outputs, replaced->layerInputs, replaced->inputsGradient);
+        }
+        replacement->kernel = replaced->kernel;
+
+        layers[layer] = replacement;
+        delete replaced;
+        return speedup;
+    }
+
+
+    unsigned int activationBackwardStep(unsigned int layer) const {
+        // the backward pass starts at step 2 * layersNumber with the loss function
+        return 2 * layersNumber + 1 + 2 * (layersNumber - 1 - layer);
+    }
+
+
+    unsigned int denseBackwardStep(unsigned int layer) const {
+        return activationBackwardStep(layer) + 1;
+    }
 };
 
@@ -0,0 +1,241 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+
+struct WeightSnapshot {
+    // network state (see Network::saveState) after samples training samples
+    std::vector<double> state;
+    unsigned long samples;
+};
+
+
+template <typename NetworkType>
+class OnlineTrainer {
+    /*
+        trains a network on an unbounded stream of samples (a pipe,
+        a file being appended to with follow, ...) in constant memory
+        samples are read microBatch at a time, every sample is
+        featuresNumber values and a label, like set.txt
+        loss and accuracy are exponentially decayed running averages
+        every publishEvery samples a snapshot of the weights is
+        published, inference threads can take it at any time with
+        getSnapshot and load it in their own network with loadState
+    */
+private:
+
+    NetworkType& network;
+    unsigned int featuresNumber;
+    unsigned int outputsNumber;
+    unsigned int microBatch;
+    unsigned long publishEvery;
+    double decay;
+
+    // constant size buffers for one micro-batch
+    double* samples;
+    unsigned int* hotOnes;
+
+    std::atomic<double> runningLoss;
+    std::atomic<double> runningAccuracy;
+    std::atomic<unsigned long> trained;
+    std::atomic<bool> stopping;
+
+    unsigned long lastPublished;
+    std::shared_ptr<const WeightSnapshot> published;
+
+    // start of a line whose end hasn't been written yet (follow)
+    std::string pending;
+
+
+public:
+
+    // --------- CONSTRUCTOR / DESTRUCTOR
+
+    OnlineTrainer(
+        NetworkType& _network,
+        unsigned int _microBatch,
+        unsigned long _publishEvery,
+        double _decay
+        )
+    : network(_network),
+      featuresNumber(_network.getInputsNumber()),
+      outputsNumber(_network.getOutputsNumber()),
+      microBatch(_microBatch > 0 ? _microBatch : 1),
+      publishEvery(_publishEvery),
+      decay(_decay),
+      runningLoss(0),
+      runningAccuracy(0),
+      trained(0),
+      stopping(false),
+      lastPublished(0)
+    {
+        samples = new double[microBatch * featuresNumber];
+        hotOnes = new unsigned int[microBatch];
+        publish();
+    }
+
+
+    ~OnlineTrainer() {
+        delete[] samples;
+        delete[] hotOnes;
+    }
+
+
+    // -------- FUNCTIONS
+
+    unsigned long train(std::istream& stream, bool follow = false) {
+        /*
+            trains until the stream ends or stop is called, with follow
+            the end of the stream is waited on like tail -f (for a file
+            being appended to) and only stop or a read error end it
+            malformed lines and labels out of range are skipped
+            returns the number of samples trained on
+            (file descriptors can be read through /dev/fd/<fd>)
+        */
+        unsigned long start = trained;
+
+        while (!stopping) {
+            unsigned int size = read(stream, follow);
+            if (size == 0) {
+                if (!follow || stream.bad()) {
+                    break;
+                }
+                // nothing new yet, the writer may still append
+                stream.clear();
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                continue;
+            }
+
+            for (unsigned int sample = 0; sample < size; sample++) {
+                network.feed(samples + sample * featuresNumber, hotOnes[sample]);
+                record(network.getLoss(), network.getOutput(), hotOnes[sample]);
+                network.backwardAndOptimize(hotOnes[sample]);
+            }
+
+            if (trained - lastPublished >= publishEvery) {
+                publish();
+            }
+        }
+
+        publish();
+        return trained - start;
+    }
+
+
+    void stop() {
+        /*
+            can be called from any thread, train returns after the
+            current micro-batch (or wait when following)
+        */
+        stopping = true;
+    }
+
+
+    std::shared_ptr<const WeightSnapshot> getSnapshot() const {
+        // can be called from any thread
+        return std::atomic_load(&published);
+    }
+
+
+    double getLoss() const {
+        return runningLoss;
+    }
+
+
+    double getAccuracy() const {
+        return runningAccuracy;
+    }
+
+
+    unsigned long getSamples() const {
+        return trained;
+    }
+
+
+    void printStats() const {
+        std::cout << "samples: " << trained
+                  << " loss: " << runningLoss
+                  << " accuracy: " << runningAccuracy << std::endl;
+    }
+
+
+private:
+
+    unsigned int read(std::istream& stream, bool follow) {
+        /*
+            reads up to microBatch samples, returns how many were read
+            when following, a last line without its newline is kept in
+            pending until the rest of it is written
+        */
+        unsigned int size = 0;
+        std::string line;
+
+        while (size < microBatch && std::getline(stream, line)) {
+            if (follow && stream.eof()) {
+                pending += line;
+                break;
+            }
+            if (!pending.empty()) {
+                line = pending + line;
+                pending.clear();
+            }
+
+            std::istringstream sample(line);
+            double* features = samples + size * featuresNumber;
+
+            unsigned int feature = 0;
+            while (feature < featuresNumber && sample >> features[feature]) {
+                feature++;
+            }
+            if (feature == featuresNumber && sample >> hotOnes[size] && hotOnes[size] < outputsNumber) {
+                size++;
+            }
+        }
+        return size;
+    }
+
+
+    void record(double loss, const double* outputs, unsigned int hotOne) {
+        // the running averages start from the first sample's values
+        unsigned int best = 0;
+        for (unsigned int output = 1; output < outputsNumber; output++) {
+            if (outputs[output] > outputs[best]) {
+                best = output;
+            }
+        }
+        double correct = best == hotOne;
+
+        if (trained == 0) {
+            runningLoss = loss;
+            runningAccuracy = correct;
+        }
+        else {
+            runningLoss = decay * runningLoss + (1 - decay) * loss;
+            runningAccuracy = decay * runningAccuracy + (1 - decay) * correct;
+        }
+        trained++;
+    }
+
+
+    void publish() {
+        /*
+            copies the weights in a new snapshot and swaps it with the
+            published one, readers keep the snapshot they hold alive
+            (a snapshot is never written once published)
+        */
+        std::shared_ptr<WeightSnapshot> snapshot = std::make_shared<WeightSnapshot>();
+        snapshot->state.resize(network.getStateSize());
+        network.saveState(snapshot->state.data());
+        snapshot->samples = trained;
+
+        std::atomic_store(&published, std::shared_ptr<const WeightSnapshot>(snapshot));
+        lastPublished = trained;
+    }
+
+};
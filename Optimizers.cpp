@@ -7,6 +7,13 @@ namespace Optimizers {
     struct Optimizer {
 
         virtual void optimize(DenseLayer* layer) {}
+
+        // optimizer state (e.g. learning rate, moments) for checkpoints
+        virtual unsigned int stateNumber() const {return 0;}
+
+        virtual void saveState(double* to) const {}
+
+        virtual void loadState(const double* from) {}
     };
 
 
@@ -23,17 +30,17 @@ namespace Optimizers {
             /* 
             Stochastic Gradient Descent 
             */
-
-        // changing weights
-        for (unsigned int neuron = 0; neuron < layer->neuronsNumber; neuron++) {
-            for (unsigned int weight = 0; weight < layer->inputsNumber; weight++) {
-                layer->weights[neuron][weight] -= learningRate * layer->weightsGradients[neuron][weight];
-            }
+            layer->applyGradients(learningRate);
         }
-        // changing biases
-        for (unsigned int bias = 0; bias < layer->neuronsNumber; bias++) {
-            layer->biases[bias] -= learningRate * layer->biasesGradient[bias];
+
+        unsigned int stateNumber() const override {return 1;}
+
+        void saveState(double* to) const override {
+            to[0] = learningRate;
         }
+
+        void loadState(const double* from) override {
+            learningRate = from[0];
         }
     
     };
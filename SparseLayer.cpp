@@ -0,0 +1,271 @@
+#pragma once
+#include <iostream>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include "DenseLayer.cpp"
+
+
+struct PruningReport {
+    /*
+        result of replacing a dense layer with a SparseLayer
+        accuracies are measured on the validation samples given to
+        Network::pruneLayer or pruneLayerBelow (-1 if none were given)
+    */
+    bool replaced;          // false if the layer couldn't be pruned
+    double threshold;
+    double sparsity;
+    unsigned long nonZeros;
+    double measuredSpeedup;
+    double accuracyBefore;
+    double accuracyAfter;
+
+    void print() const {
+        if (!replaced) {
+            std::cout << "layer not replaced: it has no dense weights to prune" << std::endl;
+            return;
+        }
+        std::cout << "threshold: " << threshold
+                  << " sparsity: " << sparsity
+                  << " non zeros: " << nonZeros
+                  << " speedup: " << measuredSpeedup;
+        if (accuracyBefore >= 0) {
+            std::cout << " accuracy: " << accuracyBefore << " -> " << accuracyAfter
+                      << " (" << accuracyAfter - accuracyBefore << ")";
+        }
+        std::cout << std::endl;
+    }
+};
+
+
+class SparseLayer : public DenseLayer {
+    /*
+        dense layer whose weights below a threshold (in absolute value)
+        are pruned, the remaining ones are stored in CSR format:
+        the weights of neuron n are values[rowStart[n] .. rowStart[n+1])
+        and multiply the inputs columns[rowStart[n] .. rowStart[n+1])
+        training keeps the sparsity pattern, only the kept weights change
+    */
+public:
+
+    unsigned int* rowStart;
+    unsigned int* columns;
+    double* values;
+    double* valuesGradients;
+
+    unsigned int nonZeros;
+
+
+    // --------- CONSTRUCTOR / DESTRUCTOR
+
+    SparseLayer(const DenseLayer& dense, double threshold)
+    : DenseLayer(dense.inputsNumber, dense.neuronsNumber, false)
+    {
+        // a layer without dense weights (see isDense) gives an empty layer
+        std::memcpy(biases, dense.biases, neuronsNumber * sizeof(double));
+
+        nonZeros = 0;
+        for (unsigned int neuron = 0; neuron < neuronsNumber && dense.isDense(); neuron++) {
+            for (unsigned int input = 0; input < inputsNumber; input++) {
+                nonZeros += fabs(dense.weights[neuron][input]) >= threshold;
+            }
+        }
+
+        rowStart = new unsigned int[neuronsNumber + 1];
+        columns = new unsigned int[nonZeros];
+        values = new double[nonZeros];
+        valuesGradients = new double[nonZeros];
+
+        unsigned int value = 0;
+        for (unsigned int neuron = 0; neuron < neuronsNumber; neuron++) {
+            rowStart[neuron] = value;
+            for (unsigned int input = 0; input < inputsNumber && dense.isDense(); input++) {
+                if (fabs(dense.weights[neuron][input]) >= threshold) {
+                    columns[value] = input;
+                    values[value] = dense.weights[neuron][input];
+                    value++;
+                }
+            }
+        }
+        rowStart[neuronsNumber] = value;
+    }
+
+
+    ~SparseLayer() {
+        delete[] rowStart;
+        delete[] columns;
+        delete[] values;
+        delete[] valuesGradients;
+    }
+
+
+    // -------- FUNCTIONS
+
+    void forward(const double* inputs) override {
+        // copying inputs for backpropagation
+        if (layerInputs != NULL && layerInputs != inputs) {
+            for (unsigned int input = 0; input < inputsNumber; input++) {
+                layerInputs[input] = inputs[input];
+            }
+        }
+
+        for (unsigned int neuron = 0; neuron < neuronsNumber; neuron++) {
+            outputs[neuron] = biases[neuron] + rowDot(neuron, inputs);
+        }
+    }
+
+
+    void forwardBatch(const double* inputs, unsigned int batchSize, double* batchOutputs) override {
+        // every row is used by the whole batch while it's in cache
+        for (unsigned int neuron = 0; neuron < neuronsNumber; neuron++) {
+            for (unsigned int sample = 0; sample < batchSize; sample++) {
+                batchOutputs[sample * neuronsNumber + neuron] =
+                    biases[neuron] + rowDot(neuron, inputs + sample * inputsNumber);
+            }
+        }
+    }
+
+
+    void backward(const double* activationGradient) override {
+        // same chain rule as DenseLayer, only for the kept weights
+        for (unsigned int input = 0; input < inputsNumber; input++) {
+            inputsGradient[input] = 0;
+        }
+
+        for (unsigned int neuron = 0; neuron < neuronsNumber; neuron++) {
+            for (unsigned int value = rowStart[neuron]; value < rowStart[neuron + 1]; value++) {
+                valuesGradients[value] = layerInputs[columns[value]] * activationGradient[neuron];
+                inputsGradient[columns[value]] += activationGradient[neuron] * values[value];
+            }
+            biasesGradient[neuron] = activationGradient[neuron];
+        }
+    }
+
+
+    void applyGradients(double learningRate) override {
+        // pruned weights stay pruned
+        for (unsigned int value = 0; value < nonZeros; value++) {
+            values[value] -= learningRate * valuesGradients[value];
+        }
+        for (unsigned int bias = 0; bias < neuronsNumber; bias++) {
+            biases[bias] -= learningRate * biasesGradient[bias];
+        }
+    }
+
+
+    unsigned int parametersNumber() const override {
+        // the sparsity pattern is fixed, only the kept weights are stored
+        return nonZeros + neuronsNumber;
+    }
+
+
+    void saveParameters(double* to) const override {
+        std::memcpy(to, values, nonZeros * sizeof(double));
+        std::memcpy(to + nonZeros, biases, neuronsNumber * sizeof(double));
+    }
+
+
+    void loadParameters(const double* from) override {
+        std::memcpy(values, from, nonZeros * sizeof(double));
+        std::memcpy(biases, from + nonZeros, neuronsNumber * sizeof(double));
+    }
+
+
+    double getSparsity() const {
+        // fraction of pruned weights
+        return 1 - (double) nonZeros / ((double) inputsNumber * neuronsNumber);
+    }
+
+
+    static double thresholdFor(const DenseLayer& dense, double sparsity) {
+        /*
+            smallest absolute value to keep so that (about) a sparsity
+            fraction of the weights is pruned, sparsity is clamped to [0, 1]
+            0 for layers without dense weights
+        */
+        if (!dense.isDense()) {
+            return 0;
+        }
+        sparsity = sparsity < 0 ? 0 : sparsity > 1 ? 1 : sparsity;
+        std::vector<double> magnitudes;
+        magnitudes.reserve(dense.inputsNumber * dense.neuronsNumber);
+        for (unsigned int neuron = 0; neuron < dense.neuronsNumber; neuron++) {
+            for (unsigned int input = 0; input < dense.inputsNumber; input++) {
+                magnitudes.push_back(fabs(dense.weights[neuron][input]));
+            }
+        }
+
+        unsigned int pruned = (unsigned int) (sparsity * magnitudes.size());
+        if (pruned == 0) {
+            return 0;
+        }
+        if (pruned >= magnitudes.size()) {
+            return HUGE_VAL;
+        }
+        std::nth_element(magnitudes.begin(), magnitudes.begin() + pruned, magnitudes.end());
+        return magnitudes[pruned];
+    }
+
+
+    // -------- PRINTING / DEBUGGING
+
+    void printWeights() const override {
+        // the full matrix, pruned weights as 0
+        for (unsigned int neuron = 0; neuron < neuronsNumber; neuron++) {
+            unsigned int value = rowStart[neuron];
+            for (unsigned int input = 0; input < inputsNumber; input++) {
+                if (value < rowStart[neuron + 1] && columns[value] == input) {
+                    std::cout << values[value++] << " ";
+                }
+                else {
+                    std::cout << 0 << " ";
+                }
+            }
+            std::cout << "\n";
+        }
+    }
+
+
+    void printWeightsGradients() const override {
+        // gradients of the kept weights only, row by row
+        for (unsigned int neuron = 0; neuron < neuronsNumber; neuron++) {
+            for (unsigned int value = rowStart[neuron]; value < rowStart[neuron + 1]; value++) {
+                std::cout << valuesGradients[value] << " ";
+            }
+            std::cout << "\n";
+        }
+    }
+
+
+    void printSparsity() const {
+        std::cout << nonZeros << " / " << inputsNumber * neuronsNumber
+                  << " weights kept (sparsity " << getSparsity() << ")" << std::endl;
+    }
+
+
+private:
+
+    double rowDot(unsigned int neuron, const double* inputs) const {
+        /*
+            gathers the inputs of the kept weights with four
+            independent accumulators, so the additions can overlap
+        */
+        const unsigned int first = rowStart[neuron];
+        const unsigned int last = rowStart[neuron + 1];
+        double sums[4] = {0, 0, 0, 0};
+
+        unsigned int value = first;
+        for (; value + 4 <= last; value += 4) {
+            sums[0] += values[value] * inputs[columns[value]];
+            sums[1] += values[value + 1] * inputs[columns[value + 1]];
+            sums[2] += values[value + 2] * inputs[columns[value + 2]];
+            sums[3] += values[value + 3] * inputs[columns[value + 3]];
+        }
+        for (; value < last; value++) {
+            sums[0] += values[value] * inputs[columns[value]];
+        }
+        return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+    }
+
+};
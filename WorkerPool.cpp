@@ -0,0 +1,130 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+
+class WorkerPool {
+    /*
+        threads started once and kept waiting for work, so splitting a
+        loop among them costs a wake up instead of starting and joining
+        threads at every call
+        run splits [0, count) in size() + 1 contiguous ranges, the
+        calling thread takes the first one and waits for the others
+        only one run at a time, a pool isn't shared between threads
+    */
+private:
+
+    std::thread* threads;
+    unsigned int workersNumber;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    // current job, generation changes every time a new one is posted
+    unsigned long generation;
+    unsigned int remaining;
+    unsigned int count;
+    unsigned int chunk;
+    void* job;
+    void (*call)(void*, unsigned int, unsigned int);
+    bool stopping;
+
+
+public:
+
+    // --------- CONSTRUCTOR / DESTRUCTOR
+
+    WorkerPool(unsigned int _workersNumber)
+    : workersNumber(_workersNumber),
+      generation(0),
+      remaining(0),
+      count(0),
+      chunk(0),
+      job(NULL),
+      call(NULL),
+      stopping(false)
+    {
+        threads = new std::thread[workersNumber];
+        for (unsigned int worker = 0; worker < workersNumber; worker++) {
+            threads[worker] = std::thread(&WorkerPool::work, this, worker + 1);
+        }
+    }
+
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (unsigned int worker = 0; worker < workersNumber; worker++) {
+            threads[worker].join();
+        }
+        delete[] threads;
+    }
+
+
+    // -------- FUNCTIONS
+
+    template <typename Function>
+    void run(unsigned int _count, Function& function) {
+        // calls function(first, last) on every range, returns when all are done
+        unsigned int _chunk = (_count + workersNumber) / (workersNumber + 1);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            count = _count;
+            chunk = _chunk;
+            job = &function;
+            call = [](void* function, unsigned int first, unsigned int last) {
+                (*(Function*) function)(first, last);
+            };
+            remaining = workersNumber;
+            generation++;
+        }
+        wake.notify_all();
+
+        function(0, _chunk < _count ? _chunk : _count);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return remaining == 0; });
+    }
+
+
+    unsigned int size() const {
+        return workersNumber;
+    }
+
+
+private:
+
+    void work(unsigned int range) {
+        unsigned long seen = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+
+        while (true) {
+            wake.wait(lock, [this, seen] { return stopping || generation != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+
+            unsigned int first = range * chunk < count ? range * chunk : count;
+            unsigned int last = first + chunk < count ? first + chunk : count;
+            void* function = job;
+            void (*callFunction)(void*, unsigned int, unsigned int) = call;
+
+            lock.unlock();
+            if (first < last) {
+                callFunction(function, first, last);
+            }
+            lock.lock();
+
+            if (--remaining == 0) {
+                done.notify_one();
+            }
+        }
+    }
+
+};
@@ -0,0 +1,74 @@
+#include "neural_network.hh"
+#include <string>
+#include <iostream>
+
+/*
+    checks that Checkpointer follows the network's state when a layer
+    is replaced: a network is checkpointed dense, after factorizing a
+    layer and after pruning another one, and every checkpoint must be
+    loaded back in a network of the same layout with the same outputs
+    a second checkpointer sized for the smaller state then checkpoints
+    a dense network, its buffers have to grow
+*/
+
+typedef Network<Activations::Relu, Activations::SoftMax, Losses::CrossEntropy, Optimizers::SGD> TestNetwork;
+
+const double sample[8] = {1.2, -2, 2.1, 0.9, 0.1, -1.4, 0.7, 0.3};
+
+bool sameOutputs(TestNetwork& a, TestNetwork& b) {
+    a.feed(sample);
+    b.feed(sample);
+    for (unsigned int output = 0; output < a.getOutputsNumber(); output++) {
+        if (a.getOutput()[output] != b.getOutput()[output]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main() {
+
+    unsigned int mismatches = 0;
+
+    TestNetwork network(8, 4, 2, 16, 0.01);
+    Checkpointer checkpointer("cptest", network.getStateSize(), 10);
+
+    // dense
+    checkpointer.checkpoint(network, 0);
+    checkpointer.wait();
+    TestNetwork dense(8, 4, 2, 16, 0.01);
+    mismatches += !dense.load(checkpointer.fileName(0).c_str()) || !sameOutputs(network, dense);
+
+    // smaller state after factorizing
+    network.factorizeLayer(1, 4);
+    checkpointer.checkpoint(network, 1);
+    checkpointer.wait();
+    TestNetwork factorized(8, 4, 2, 16, 0.01);
+    factorized.factorizeLayer(1, 4, true);
+    mismatches += !factorized.load(checkpointer.fileName(1).c_str()) || !sameOutputs(network, factorized);
+    // the layout changed, a dense network must refuse it
+    mismatches += dense.load(checkpointer.fileName(1).c_str());
+
+    // and after pruning
+    network.pruneLayer(2, 0.5);
+    checkpointer.checkpoint(network, 2);
+    checkpointer.wait();
+    factorized.pruneLayer(2, 0.5);
+    mismatches += !factorized.load(checkpointer.fileName(2).c_str()) || !sameOutputs(network, factorized);
+
+    // bigger state than the buffers
+    Checkpointer small("cptest", network.getStateSize(), 10);
+    small.checkpoint(dense, 3);
+    small.wait();
+    TestNetwork loaded(8, 4, 2, 16, 0.01);
+    mismatches += !loaded.load(small.fileName(3).c_str()) || !sameOutputs(dense, loaded);
+
+    mismatches += checkpointer.getFailures() + small.getFailures();
+
+    for (unsigned long step = 0; step < 4; step++) {
+        remove(checkpointer.fileName(step).c_str());
+    }
+
+    std::cout << "mismatches: " << mismatches << std::endl;
+    return mismatches != 0;
+}
@@ -0,0 +1,81 @@
+#include "neural_network.hh"
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <cmath>
+
+/*
+    checks that every model of a ModelBatch is the network it claims
+    to be: Models networks with different learning rates and seeds are
+    trained on set.txt, then the state of every model is loaded in a
+    Network which must give the same outputs on every sample
+    (up to rounding, the sums aren't done in the same order)
+*/
+
+typedef Network<Activations::Relu, Activations::SoftMax, Losses::CrossEntropy, Optimizers::SGD> TestNetwork;
+
+const unsigned int Models = 4;
+
+int main() {
+
+    const double learningRates[Models] = {0.001, 0.003, 0.01, 0.03};
+    const unsigned int seeds[Models] = {1, 2, 3, 4};
+    ModelBatch<Models> batch(8, 4, 2, 8, learningRates, seeds);
+
+    std::string fileName = "set.txt";
+    std::ifstream file;
+
+    double data[8];
+    unsigned int hotOne;
+
+    for (int epoch = 0; epoch < 20; epoch++) {
+        file.open(fileName);
+        while (file >> data[0] >> data[1] >> data[2] >> data[3] >> data[4] >> data[5] >> data[6] >> data[7] >> hotOne) {
+            batch.feed(data, hotOne);
+            batch.backwardAndOptimize();
+        }
+        file.close();
+    }
+
+    unsigned int mismatches = 0;
+    double* state = new double[batch.getModelStateSize()];
+
+    for (unsigned int model = 0; model < Models; model++) {
+        TestNetwork network(8, 4, 2, 8, 0);
+        if (network.getStateSize() != batch.getModelStateSize()) {
+            std::cout << "state sizes differ: " << network.getStateSize()
+                      << " " << batch.getModelStateSize() << std::endl;
+            return 1;
+        }
+        batch.saveModelState(model, state);
+        network.loadState(state);
+
+        double largestError = 0;
+        file.open(fileName);
+        while (file >> data[0] >> data[1] >> data[2] >> data[3] >> data[4] >> data[5] >> data[6] >> data[7] >> hotOne) {
+            batch.feed(data, hotOne);
+            network.feed(data, hotOne);
+
+            for (unsigned int output = 0; output < 2; output++) {
+                double error = fabs(batch.getOutput(model, output) - network.getOutput()[output]);
+                largestError = error > largestError ? error : largestError;
+            }
+            mismatches += fabs(batch.getLoss(model) - network.getLoss()) > 1e-9;
+        }
+        file.close();
+
+        // the learning rate is part of the state too
+        network.saveState(state);
+        mismatches += state[network.getStateSize() - 1] != learningRates[model];
+        mismatches += largestError > 1e-9;
+
+        std::cout << "model " << model << " learning rate " << learningRates[model]
+                  << " loss " << batch.getLoss(model)
+                  << " largest output error " << largestError << std::endl;
+    }
+
+    delete[] state;
+
+    std::cout << "mismatches: " << mismatches << std::endl;
+    return mismatches != 0;
+}
@@ -4,6 +4,15 @@
 #include "Losses.cpp"
 #include "Optimizers.cpp"
 #include "Datasets.cpp"
+#include "ModelBatch.cpp"
+#include "Checkpoint.cpp"
+#include "MemoryPlan.cpp"
+#include "Autotuner.cpp"
+#include "WorkerPool.cpp"
+#include "LowRankLayer.cpp"
+#include "SparseLayer.cpp"
+#include "InferenceServer.cpp"
+#include "OnlineTrainer.cpp"
 
 namespace Datasets{};
 
@@ -20,3 +29,9 @@ template <
             typename OptimizerType
         >
 class Network;
+
+template <unsigned int Models>
+class ModelBatch;
+
+template <typename NetworkType>
+class OnlineTrainer;
@@ -0,0 +1,79 @@
+#include "neural_network.hh"
+#include <string>
+#include <fstream>
+#include <iostream>
+
+/*
+    checks that planMemory doesn't change what a network computes:
+    a network with private buffers, one planned for training and one
+    planned for inference start from the same weights, the first two
+    are trained on set.txt side by side and after every epoch all three
+    must give bit-identical outputs
+*/
+
+typedef Network<Activations::Relu, Activations::SoftMax, Losses::CrossEntropy, Optimizers::SGD> TestNetwork;
+
+bool sameOutputs(const TestNetwork& a, const TestNetwork& b) {
+    for (unsigned int output = 0; output < a.getOutputsNumber(); output++) {
+        if (a.getOutput()[output] != b.getOutput()[output]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main() {
+
+    TestNetwork unplanned(8, 4, 2, 8, 0.001);
+    TestNetwork training(8, 4, 2, 8, 0.001);
+    TestNetwork inference(8, 4, 2, 8, 0.001);
+
+    // same starting weights for all of them
+    double* state = new double[unplanned.getStateSize()];
+    unplanned.saveState(state);
+    training.loadState(state);
+
+    training.planMemory(true);
+    inference.planMemory(false);
+
+    std::string fileName = "set.txt";
+    std::ifstream file;
+
+    double data[8];
+    unsigned int hotOne;
+    unsigned int mismatches = 0;
+
+    for (int epoch = 0; epoch < 20; epoch++) {
+        file.open(fileName);
+
+        while (file >> data[0] >> data[1] >> data[2] >> data[3] >> data[4] >> data[5] >> data[6] >> data[7] >> hotOne) {
+            unplanned.feed(data, hotOne);
+            training.feed(data, hotOne);
+            mismatches += !sameOutputs(unplanned, training) || unplanned.getLoss() != training.getLoss();
+
+            unplanned.backwardAndOptimize(hotOne);
+            training.backwardAndOptimize(hotOne);
+        }
+        file.close();
+
+        // the inference network follows the trained weights
+        unplanned.saveState(state);
+        inference.loadState(state);
+
+        file.open(fileName);
+        while (file >> data[0] >> data[1] >> data[2] >> data[3] >> data[4] >> data[5] >> data[6] >> data[7] >> hotOne) {
+            unplanned.feed(data);
+            training.feed(data);
+            inference.feed(data);
+            mismatches += !sameOutputs(unplanned, training) || !sameOutputs(unplanned, inference);
+        }
+        file.close();
+    }
+
+    delete[] state;
+
+    std::cout << "memory: training " << training.getMemorySize()
+              << " inference " << inference.getMemorySize() << std::endl;
+    std::cout << "mismatches: " << mismatches << std::endl;
+    return mismatches != 0;
+}
@@ -0,0 +1,87 @@
+#include "neural_network.hh"
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <cstdlib>
+
+/*
+    local inference front end for load testing
+    usage: serve [network file] [max batch] [max delay us] < samples
+    every line of stdin is a sample (8 whitespace separated values, like set.txt
+    without the label), the network outputs are printed in the same order
+    latency and throughput are printed on stderr at the end
+*/
+
+int main(int argc, char** argv) {
+
+    Network<Activations::Relu, Activations::SoftMax, Losses::CrossEntropy, Optimizers::SGD> network(
+        8, // inputs number
+        4, // layers number
+        2, // outputs number
+        8, // neuron per layer
+        0.001 // learning rate
+    );
+
+    if (argc > 1 && !network.load(argv[1])) {
+        std::cerr << "can't load " << argv[1] << std::endl;
+        return 1;
+    }
+    int maxBatch = argc > 2 ? atoi(argv[2]) : 32;
+    int maxDelay = argc > 3 ? atoi(argv[3]) : 200;
+    if (maxBatch <= 0 || maxDelay < 0) {
+        std::cerr << "max batch must be positive and max delay not negative" << std::endl;
+        return 1;
+    }
+
+    std::deque<std::future<std::vector<double>>> pending;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool done = false;
+
+    InferenceServer<decltype(network)> server(network, maxBatch, maxDelay);
+
+    // prints results in request order while requests keep coming
+    std::thread printer([&] {
+        while (true) {
+            std::future<std::vector<double>> result;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [&] {return !pending.empty() || done;});
+                if (pending.empty()) {
+                    return;
+                }
+                result = std::move(pending.front());
+                pending.pop_front();
+            }
+            for (double output : result.get()) {
+                std::cout << output << " ";
+            }
+            std::cout << "\n";
+        }
+    });
+
+    std::string line;
+    double data[8];
+    while (std::getline(std::cin, line)) {
+        std::istringstream sample(line);
+        if (!(sample >> data[0] >> data[1] >> data[2] >> data[3] >> data[4] >> data[5] >> data[6] >> data[7])) {
+            continue;
+        }
+        std::future<std::vector<double>> result = server.submit(data);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.push_back(std::move(result));
+        }
+        condition.notify_one();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+    }
+    condition.notify_one();
+    printer.join();
+
+    server.getStats().print(std::cerr);
+    return 0;
+}
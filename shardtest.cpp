@@ -0,0 +1,97 @@
+#include "neural_network.hh"
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+
+/*
+    checks the binary shard format: set.txt is converted in shards,
+    streamed back with ShardedDataset and every row and label must be
+    found (in any order, the dataset is shuffled) with the values of
+    the text file rounded to float
+    a smaller file converted to the same prefix must replace the whole
+    dataset, and a malformed one must be reported
+*/
+
+using namespace Datasets;
+
+typedef std::vector<double> Row;     // features followed by the label
+
+std::vector<Row> readText(const char* fileName) {
+    std::vector<Row> rows;
+    std::ifstream file(fileName);
+    Row row(9);
+    while (file >> row[0] >> row[1] >> row[2] >> row[3] >> row[4] >> row[5] >> row[6] >> row[7] >> row[8]) {
+        for (unsigned int feature = 0; feature < 8; feature++) {
+            row[feature] = (float) row[feature];
+        }
+        rows.push_back(row);
+    }
+    return rows;
+}
+
+std::vector<Row> readShards(const char* prefix) {
+    std::vector<Row> rows;
+    ShardedDataset dataset(64, 1);
+    dataset.load(prefix);
+
+    double features[8];
+    unsigned int hotOne;
+    while (dataset.next(features, hotOne)) {
+        Row row(features, features + 8);
+        row.push_back(hotOne);
+        rows.push_back(row);
+    }
+    if (rows.size() != dataset.size) {
+        std::cout << "load found " << dataset.size << " rows, " << rows.size() << " were read" << std::endl;
+        rows.clear();
+    }
+    return rows;
+}
+
+int main() {
+
+    const char* prefix = "shardtest";
+    unsigned int mismatches = 0;
+    std::string error;
+
+    // round trip
+    std::vector<Row> expected = readText("set.txt");
+    unsigned int shards = convertText("set.txt", prefix, 8, 100, &error);
+    mismatches += shards != (expected.size() + 99) / 100 || !error.empty();
+
+    std::vector<Row> rows = readShards(prefix);
+    std::sort(expected.begin(), expected.end());
+    std::sort(rows.begin(), rows.end());
+    mismatches += rows != expected;
+    std::cout << "set.txt: " << shards << " shards, " << rows.size() << " rows" << std::endl;
+
+    // a smaller dataset in the same prefix
+    {
+        std::ofstream small("shardtest.txt");
+        small << "1 2 3 4 5 6 7 8 1\n8 7 6 5 4 3 2 1 0\n";
+    }
+    shards = convertText("shardtest.txt", prefix, 8, 100, &error);
+    expected = readText("shardtest.txt");
+    rows = readShards(prefix);
+    std::sort(expected.begin(), expected.end());
+    std::sort(rows.begin(), rows.end());
+    mismatches += shards != 1 || !error.empty() || rows != expected;
+    std::cout << "shardtest.txt: " << shards << " shards, " << rows.size() << " rows" << std::endl;
+
+    // malformed line
+    {
+        std::ofstream malformed("shardtest.txt");
+        malformed << "1 2 3 4 5 6 7 8 1\n8 7 x 5 4 3 2 1 0\n";
+    }
+    shards = convertText("shardtest.txt", prefix, 8, 100, &error);
+    mismatches += error.empty();
+    std::cout << "malformed: " << shards << " shards, error: " << error << std::endl;
+
+    for (unsigned int shard = 0; remove(shardName(prefix, shard).c_str()) == 0; shard++) {}
+    remove("shardtest.txt");
+
+    std::cout << "mismatches: " << mismatches << std::endl;
+    return mismatches != 0;
+}